@@ -162,7 +162,7 @@ int read_n_objects(int     isBinaryFile,  /* flag: 0 or 1 */
 {
     int i, j, len;
 
-    if (isBinaryFile) {  /* using MPI-IO to read file concurrently */
+    if (isBinaryFile) {  /* input file is in raw binary format -------------*/
         int infile;
         if ((infile = open(filename, O_RDONLY, "0600")) == -1) {
             fprintf(stderr, "Error: open file %s (err=%s)\n",filename,strerror(errno));
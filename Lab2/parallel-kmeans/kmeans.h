@@ -15,19 +15,205 @@
 #define _H_KMEANS
 
 #include <assert.h>
+#include <stddef.h>
 
+/* per-thread buffers are padded to whole cache lines, so no two threads'
+ * buffers share one
+ */
+#define CACHE_LINE 64
+
+/* round a byte count up to a whole number of cache lines */
+#define PAD_TO_LINE(bytes) (((bytes) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+/* accumulation strategies of omp_kmeans() */
+#define KMEANS_REDUCE_PRIVATE 0  /* per-thread partial sums (default) */
+#define KMEANS_REDUCE_REPRO   1  /* per-cluster sums in object order, in double:
+                                    bitwise identical for any thread count */
+#define KMEANS_REDUCE_ATOMIC  2  /* atomic updates into shared sums, optionally
+                                    sharded into per-socket replicas */
+
+/* distance kernels of omp_kmeans() */
+#define KMEANS_KERNEL_FULL    0  /* full distance to every center (default) */
+#define KMEANS_KERNEL_PDS     1  /* partial-distance search with early exit */
+
+#define KMEANS_SCHED_STATIC   0  /* equal contiguous object ranges (default) */
+#define KMEANS_SCHED_ADAPTIVE 1  /* contiguous ranges sized by each thread's
+                                    measured assignment throughput */
+
+/* thread pinning policies of topology_pin_threads() */
+#define TOPOLOGY_PIN_NONE    0
+#define TOPOLOGY_PIN_COMPACT 1
+#define TOPOLOGY_PIN_SCATTER 2
+#define TOPOLOGY_PIN_CORE    3
+
+/* one cpu of the machine, see topology_cpus() */
+typedef struct {
+    int cpu;
+    int socket;
+    int core;                    /* physical core id within the socket */
+    int efficiency;              /* 1 for an efficiency (E) core */
+} topology_cpu;
+
+/* phases of an omp_kmeans() iteration recorded in a kmeans_trace */
+#define TRACE_ASSIGN      0      /* assignment + local accumulation */
+#define TRACE_WAIT        1      /* barrier after the assignment */
+#define TRACE_REDUCE      2      /* combining the threads' partial results */
+#define TRACE_UPDATE      3      /* recomputing the centers */
+#define TRACE_CHECK       4      /* convergence check (one thread) */
+#define TRACE_REORDER     5      /* regrouping objects by cluster */
+#define TRACE_NUM_PHASES  6
+
+typedef struct {
+    double start, end;           /* omp_get_wtime() */
+    float  delta;                /* TRACE_CHECK: fraction of objects changed */
+    int    iteration;
+    int    thread;
+    int    phase;                /* one of TRACE_* */
+} kmeans_trace_event;
+
+/* ring buffer of the last `capacity` events */
+typedef struct {
+    kmeans_trace_event *events;
+    long    capacity;
+    long    count;               /* events recorded so far */
+    double  origin;              /* time of trace_create() */
+} kmeans_trace;
+
+/* tuning knobs of omp_kmeans(); a NULL pointer selects the defaults */
+typedef struct {
+    int reduction;               /* one of KMEANS_REDUCE_* */
+    int shards;                  /* KMEANS_REDUCE_ATOMIC: no. replicas of the
+                                    shared sums, 0 or 1 means a single copy */
+    int kernel;                  /* one of KMEANS_KERNEL_* */
+    int reorder;                 /* > 0: regroup the objects by cluster every
+                                    this many iterations, 0 means never */
+    const int *weights;          /* per-object multiplicities (see
+                                    coreset_collapse()), NULL means all 1 */
+    kmeans_trace *trace;         /* if not NULL, per-phase timestamps of
+                                    every thread are recorded here */
+    int schedule;                /* one of KMEANS_SCHED_* */
+} kmeans_opts;
+
+/* Every buffer of an omp_kmeans() run, laid out in one caller-provided
+ * arena by omp_kmeans_workspace(). It serves any run of up to maxObjs
+ * objects, maxClusters clusters, maxCoords coordinates and maxThreads
+ * threads whose options need no more than the ones it was laid out for.
+ * seq_kmeans_run() uses newClusterSize and newClusters[0] of it.
+ */
+typedef struct {
+    int      maxObjs, maxClusters, maxCoords, maxThreads;
+    int      reduction, shards;  /* of the options it was laid out for */
+    int      reorder, weighted;  /* 1 if the reordering (and its weight)
+                                    copies are there */
+
+    char    *threadBlocks;       /* thread t: threadStride bytes at t * threadStride,
+                                    sizes, then sums at sumOffset, then the
+                                    segmented run at runOffset */
+    size_t   threadStride, sumOffset, runOffset;
+
+    int     *newClusterSize;     /* [shards][maxClusters] */
+    float  **newClusters;        /* [maxClusters] rows of newClusters[0], which
+                                    holds [shards][maxClusters][maxCoords] */
+    int    **partialClusterSize; /* [maxThreads] */
+    float  **partialClusters;    /* [maxThreads] */
+    int     *socketOf, *members, *groupStart, *rangeStart;
+    double  *threadSpeed;
+    int     *order, *clusterStart;   /* KMEANS_REDUCE_REPRO */
+    double  *rowSum;
+    float  **sortedObjs[2];      /* reordering */
+    float   *sortedData[2];
+    int     *sortedMemb[2], *sortedPerm[2], *sortedWeight[2];
+    int     *reorderCount;
+} kmeans_workspace;
+
+/* sparse data set in CSR form (read with sparse_read()): the non-zeros of
+ * object i are colIdx/values[rowStart[i] .. rowStart[i+1])
+ */
+typedef struct {
+    int    numObjs;
+    int    numCoords;
+    long   nnz;
+    long  *rowStart;             /* [numObjs + 1] */
+    int   *colIdx;               /* [nnz] */
+    float *values;               /* [nnz] */
+} kmeans_csr;
+
+/* one configuration of omp_multi_kmeans() */
+typedef struct {
+    int      numClusters;
+    float  **clusters;           /* in: initial centers, out: final centers */
+    int     *membership;         /* [numObjs] */
+    int      iterations;         /* out: no. assignment passes */
+    double   inertia;            /* out: sum of squared distances of the
+                                    last assignment */
+} kmeans_config;
+
+/* the k-means engines return the number of iterations run, 0 on failure */
 int seq_kmeans(float**, int, int, int, float, int*, float**);
-int omp_kmeans(float**, int, int, int, float, int*, float**);
+int omp_kmeans(float**, int, int, int, float, int*, float**, const kmeans_opts*);
+
+/* the same engines on a caller-provided workspace; they never allocate */
+int    seq_kmeans_run(float**, int, int, int, float, int*, float**, int*, float*);
+size_t omp_kmeans_workspace(kmeans_workspace*, void*, int, int, int, int, const kmeans_opts*);
+int    omp_kmeans_run(float**, int, int, int, float, int*, float**, const kmeans_opts*,
+                      kmeans_workspace*);
+int omp_bf16_kmeans(float**, int, int, int, float, int*, float**);
+int omp_kdtree_kmeans(float**, int, int, int, float, int*, float**);
+int omp_yinyang_kmeans(float**, int, int, int, float, int*, float**);
+int omp_sparse_kmeans(const kmeans_csr*, int, float, int*, float**);
+int omp_multi_kmeans(float**, int, int, float, kmeans_config*, int);
+
+float** coreset_collapse(float**, int, int, int*, int**, int*);
+
+kmeans_trace* trace_create(long);
+void          trace_free(kmeans_trace*);
+void          trace_record(kmeans_trace*, int, int, double, double, double);
+int           trace_write(const kmeans_trace*, const char*);
+
+/* reusable context: kmeans_ctx_run() clusters up to the limits given at
+ * kmeans_ctx_create() without allocating, optionally warm-started from the
+ * previous run's centers
+ */
+#define KMEANS_CTX_SEQ 0
+#define KMEANS_CTX_OMP 1
+
+typedef struct kmeans_ctx kmeans_ctx;
+
+kmeans_ctx* kmeans_ctx_create(int, int, int, int, const kmeans_opts*);
+void        kmeans_ctx_destroy(kmeans_ctx*);
+int         kmeans_ctx_run(kmeans_ctx*, int, float**, int, int, int, float, int, int*, float**,
+                           const kmeans_opts*);
+
+int omp_kmeanspp_seed(float**, int, int, int, unsigned int, float**);
+int omp_kmeans_parallel_seed(float**, int, int, int, unsigned int, float**);
 
 float** file_read(int, char*, int*, int*);
 int     file_write(char*, int, int, int, float**, int*, int);
 
 int read_n_objects(int, char*, int, int, float**);
 
+kmeans_csr* sparse_read(int, char*);
+void        sparse_free(kmeans_csr*);
+
 int check_repeated_clusters(int, int, float**);
 
+int topology_cpu_socket(int);
+int topology_current_socket(void);
+int topology_cpus(const topology_cpu**);
+int topology_summary(int*, int*, int*);
+int topology_pin_order(int, int*);
+int topology_pin_threads(int, int);
+int topology_parse_policy(const char*);
+const char* topology_policy_name(int);
+
 double  wtime(void);
 
+#ifdef MPI_VERSION
+/* MPI driver, only visible to sources that include mpi.h first */
+int     mpi_kmeans(float**, int, int, int, float, int*, float**, MPI_Comm);
+float** mpi_read(int, char*, int*, int*, int*, int*, MPI_Comm);
+#endif
+
 extern int _debug;
 
 #endif
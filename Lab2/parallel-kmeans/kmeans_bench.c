@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+int _debug;
+
+#define MAX_LIST 32
+
+/* engines the benchmark can run in-process */
+#define BENCH_SEQ     0
+#define BENCH_LLOYD   1
+#define BENCH_PDS     2
+#define BENCH_REPRO   3
+#define BENCH_ATOMIC  4
+#define BENCH_BF16    5
+#define BENCH_KDTREE  6
+#define BENCH_YINYANG 7
+#define NUM_ENGINES   8
+
+static const char *bench_names[NUM_ENGINES] =
+    { "seq", "lloyd", "pds", "repro", "atomic", "bf16", "kdtree", "yinyang" };
+
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches]\n"
+        "       -N n1,n2,...   : numbers of points (default: 100000; 1e6 etc. accepted)\n"
+        "       -D d1,d2,...   : numbers of coordinates (default: 16)\n"
+        "       -K k1,k2,...   : numbers of clusters/blobs (default: 16)\n"
+        "       -O overlap     : blob std. deviation relative to the mean distance\n"
+        "                        between blob centers (default: 0.15)\n"
+        "       -T t1,t2,...   : OpenMP thread counts (default: 1,2,4,... up to max)\n"
+        "       -e e1,e2,...   : engines: seq,lloyd,pds,repro,atomic,bf16,kdtree,\n"
+        "                        yinyang (default: all)\n"
+        "       -r runs        : repetitions of every measurement (default: 3)\n"
+        "       -t threshold   : threshold value (default: 0.001)\n"
+        "       -S seed        : data generator seed (default: 1)\n"
+        "       -f format      : csv (default) or json\n"
+        "       -o file        : write the results to file (default: stdout)\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0);
+    exit(-1);
+}
+
+/* parse a comma separated list of numbers (scientific notation allowed) */
+static int parse_list(char *arg, long *list) {
+    int n = 0;
+
+    for (char *tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (n == MAX_LIST) return -1;
+        list[n] = (long)strtod(tok, NULL);
+        if (list[n] <= 0) return -1;
+        n++;
+    }
+
+    return n;
+}
+
+/* a metric that may be undefined: "null" (JSON) or empty (CSV) if NaN */
+static const char* format_metric(char *buf, size_t len, double v, int isJson) {
+    if (isnan(v)) return isJson ? "null" : "";
+    snprintf(buf, len, "%.4f", v);
+    return buf;
+}
+
+/* counter-based generator: the same value for (seed, i) on any thread */
+__inline static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x  = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x  = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* uniform in (0, 1) */
+__inline static double uniform(uint64_t seed, uint64_t i) {
+    return ((splitmix64(seed ^ splitmix64(i)) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/* Gaussian blobs: K centers uniform in [0, 100)^D, each point picks a blob
+ * and adds N(0, sigma^2) noise per coordinate (Box-Muller), with sigma =
+ * overlap * 100 / K^(1/D), the typical spacing of the centers. Generated in
+ * parallel; the data only depends on the seed. Layout as file_read().
+ */
+static float** generate_blobs(long numObjs, int numCoords, int numBlobs, float overlap,
+                              unsigned int seed) {
+    float  *centers = (float*) malloc((size_t)numBlobs * numCoords * sizeof(float));
+    float **objects = (float**) malloc(numObjs * sizeof(float*));
+    if (centers == NULL || objects == NULL) {
+        free(centers);
+        free(objects);
+        return NULL;
+    }
+    objects[0] = (float*) malloc((size_t)numObjs * numCoords * sizeof(float));
+    if (objects[0] == NULL) {
+        free(centers);
+        free(objects);
+        return NULL;
+    }
+
+    double sigma = overlap * 100.0 / pow((double)numBlobs, 1.0 / numCoords);
+
+    for (long i = 0; i < (long)numBlobs * numCoords; i++)
+        centers[i] = (float)(100.0 * uniform(seed, i));
+
+    uint64_t base = (uint64_t)numBlobs * numCoords;
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < numObjs; i++) {
+        uint64_t ctr  = base + (uint64_t)i * (numCoords + 2);
+        int      blob = (int)(uniform(seed, ctr) * numBlobs);
+        float   *obj  = objects[0] + (size_t)i * numCoords;
+
+        objects[i] = obj;
+        for (int j = 0; j < numCoords; j++) {
+            double u1 = uniform(seed, ctr + 1 + j);
+            double u2 = uniform(seed + 1, ctr + 1 + j);
+            double z  = sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+
+            obj[j] = (float)(centers[(size_t)blob * numCoords + j] + sigma * z);
+        }
+    }
+
+    free(centers);
+    return objects;
+}
+
+/* run one engine once from the given initial centers; returns iterations */
+static int run_engine(int engine, float **objects, int numCoords, int numObjs,
+                      int numClusters, float threshold, int *membership,
+                      float **clusters) {
+    kmeans_opts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    switch (engine) {
+        case BENCH_SEQ:
+            return seq_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                              membership, clusters);
+        case BENCH_BF16:
+            return omp_bf16_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                                   membership, clusters);
+        case BENCH_KDTREE:
+            return omp_kdtree_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                                     membership, clusters);
+        case BENCH_YINYANG:
+            return omp_yinyang_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                                      membership, clusters);
+        case BENCH_PDS:
+            opts.kernel = KMEANS_KERNEL_PDS;
+            break;
+        case BENCH_REPRO:
+            opts.reduction = KMEANS_REDUCE_REPRO;
+            break;
+        case BENCH_ATOMIC:
+            opts.reduction = KMEANS_REDUCE_ATOMIC;
+            break;
+    }
+
+    return omp_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                      membership, clusters, &opts);
+}
+
+/* Benchmark driver: for every (N, D, K) generates a blob data set, then
+ * times each engine for each thread count from the same initial centers
+ * (the first K points) and writes one record per run. Per-iteration time
+ * is the total over the iterations reported by the engine; GB/s counts the
+ * objects streamed once per iteration; speedup and efficiency are relative
+ * to the mean time per iteration of seq_kmeans on the same data, if run.
+ */
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           long    Ns[MAX_LIST], Ds[MAX_LIST], Ks[MAX_LIST], Ts[MAX_LIST];
+           int     numN, numD, numK, numT, runs, isJson, first;
+           int     useEngine[NUM_ENGINES];
+           float   threshold, overlap;
+           unsigned int seed;
+           FILE   *out;
+
+    _debug    = 0;
+    Ns[0]     = 100000;
+    Ds[0]     = 16;
+    Ks[0]     = 16;
+    numN      = numD = numK = 1;
+    numT      = 0;
+    runs      = 3;
+    threshold = 0.001f;
+    overlap   = 0.15f;
+    seed      = 1;
+    isJson    = 0;
+    out       = stdout;
+    for (int e = 0; e < NUM_ENGINES; e++) useEngine[e] = 1;
+
+    while ((opt = getopt(argc, argv, "N:D:K:O:T:e:r:t:S:f:o:h")) != EOF) {
+        switch (opt) {
+            case 'N':
+                if ((numN = parse_list(optarg, Ns)) <= 0) usage(argv[0]);
+                break;
+            case 'D':
+                if ((numD = parse_list(optarg, Ds)) <= 0) usage(argv[0]);
+                break;
+            case 'K':
+                if ((numK = parse_list(optarg, Ks)) <= 0) usage(argv[0]);
+                break;
+            case 'T':
+                if ((numT = parse_list(optarg, Ts)) <= 0) usage(argv[0]);
+                break;
+            case 'O':
+                overlap = (float)atof(optarg);
+                break;
+            case 'e':
+                for (int e = 0; e < NUM_ENGINES; e++) useEngine[e] = 0;
+                for (char *tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                    int e;
+                    for (e = 0; e < NUM_ENGINES; e++)
+                        if (strcmp(tok, bench_names[e]) == 0) break;
+                    if (e == NUM_ENGINES) usage(argv[0]);
+                    useEngine[e] = 1;
+                }
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                if (runs < 1) usage(argv[0]);
+                break;
+            case 't':
+                threshold = (float)atof(optarg);
+                break;
+            case 'S':
+                seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                if (strcmp(optarg, "json") == 0) isJson = 1;
+                else if (strcmp(optarg, "csv") == 0) isJson = 0;
+                else usage(argv[0]);
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    fprintf(stderr, "Error: cannot create %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                break;
+        }
+    }
+
+    /* default thread counts: powers of two up to the maximum, and the maximum */
+    if (numT == 0) {
+        int maxThreads = omp_get_max_threads();
+        for (long t = 1; t < maxThreads && numT < MAX_LIST - 1; t *= 2)
+            Ts[numT++] = t;
+        Ts[numT++] = maxThreads;
+    }
+
+    if (isJson) fprintf(out, "[\n");
+    else fprintf(out, "engine,numObjs,numCoords,numClusters,threads,run,iterations,"
+                      "seconds,sec_per_iter,point_clusters_per_sec,gb_per_sec,"
+                      "speedup,efficiency\n");
+    first = 1;
+
+    for (int a = 0; a < numN; a++)
+    for (int b = 0; b < numD; b++)
+    for (int c = 0; c < numK; c++) {
+        int numObjs = (int)Ns[a], numCoords = (int)Ds[b], numClusters = (int)Ks[c];
+
+        if (numObjs < numClusters) continue;
+
+        float **objects = generate_blobs(numObjs, numCoords, numClusters, overlap, seed);
+        if (objects == NULL) {
+            fprintf(stderr, "Error: out of memory for %d x %d points\n", numObjs, numCoords);
+            continue;
+        }
+        fprintf(stderr, "data set: %d points, %d coordinates, %d clusters\n",
+                numObjs, numCoords, numClusters);
+
+        int    *membership = (int*)    malloc((size_t)numObjs * sizeof(int));
+        float **clusters   = (float**) malloc(numClusters * sizeof(float*));
+        assert(membership != NULL && clusters != NULL);
+        clusters[0] = (float*) malloc((size_t)numClusters * numCoords * sizeof(float));
+        assert(clusters[0] != NULL);
+        for (int i = 1; i < numClusters; i++)
+            clusters[i] = clusters[i - 1] + numCoords;
+
+        double seqPerIter = 0.0;  /* baseline, 0 if seq is not run */
+        double bytes      = (double)numObjs * numCoords * sizeof(float);
+
+        for (int e = 0; e < NUM_ENGINES; e++) {
+            if (!useEngine[e]) continue;
+
+            for (int t = 0; t < ((e == BENCH_SEQ) ? 1 : numT); t++) {
+                int threads = (e == BENCH_SEQ) ? 1 : (int)Ts[t];
+                omp_set_num_threads(threads);
+
+                for (int r = 0; r < runs; r++) {
+                    memcpy(clusters[0], objects[0], (size_t)numClusters * numCoords * sizeof(float));
+
+                    double timing = wtime();
+                    int    iters  = run_engine(e, objects, numCoords, numObjs, numClusters,
+                                               threshold, membership, clusters);
+                    timing = wtime() - timing;
+                    if (iters <= 0) {
+                        fprintf(stderr, "Error: %s failed\n", bench_names[e]);
+                        continue;
+                    }
+
+                    double perIter = timing / iters;
+                    if (e == BENCH_SEQ) seqPerIter += perIter / runs;
+
+                    double speedup    = (seqPerIter > 0.0 && e != BENCH_SEQ) ? seqPerIter / perIter
+                                      : (e == BENCH_SEQ) ? 1.0 : NAN;
+                    double efficiency = speedup / threads;
+                    double pcs        = (double)numObjs * numClusters / perIter;
+                    double gbs        = bytes / perIter * 1e-9;
+
+                    char spBuf[32], effBuf[32];
+                    const char *sp  = format_metric(spBuf, sizeof(spBuf), speedup, isJson);
+                    const char *eff = format_metric(effBuf, sizeof(effBuf), efficiency, isJson);
+
+                    if (isJson)
+                        fprintf(out, "%s  {\"engine\": \"%s\", \"numObjs\": %d, \"numCoords\": %d, "
+                                "\"numClusters\": %d, \"threads\": %d, \"run\": %d, "
+                                "\"iterations\": %d, \"seconds\": %.6f, \"sec_per_iter\": %.6e, "
+                                "\"point_clusters_per_sec\": %.6e, \"gb_per_sec\": %.4f, "
+                                "\"speedup\": %s, \"efficiency\": %s}",
+                                first ? "" : ",\n", bench_names[e], numObjs, numCoords,
+                                numClusters, threads, r, iters, timing, perIter, pcs, gbs,
+                                sp, eff);
+                    else
+                        fprintf(out, "%s,%d,%d,%d,%d,%d,%d,%.6f,%.6e,%.6e,%.4f,%s,%s\n",
+                                bench_names[e], numObjs, numCoords, numClusters, threads, r,
+                                iters, timing, perIter, pcs, gbs, sp, eff);
+                    fflush(out);
+                    first = 0;
+                }
+            }
+        }
+
+        free(membership);
+        free(clusters[0]);
+        free(clusters);
+        free(objects[0]);
+        free(objects);
+    }
+
+    if (isJson) fprintf(out, "\n]\n");
+    if (out != stdout) fclose(out);
+
+    return 0;
+}
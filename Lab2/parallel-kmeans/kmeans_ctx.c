@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* Everything a run needs, carved out of one cache-line aligned arena at
+ * kmeans_ctx_create(): the workspace of omp_kmeans_run() (whose global
+ * accumulators seq_kmeans_run() borrows), then the centers of the last run.
+ * kmeans_ctx_run() never allocates.
+ */
+struct kmeans_ctx {
+    int               maxObjs, maxClusters, maxCoords, maxThreads;
+    char             *arena;
+    kmeans_workspace  ws;
+
+    /* centers of the last run, for warm starts */
+    float  *lastCenters;
+    int     lastClusters, lastCoords;
+};
+
+/* Create a context for up to maxObjs objects, maxClusters clusters and
+ * maxCoords coordinates, run by up to maxThreads threads (<= 0: the OpenMP
+ * default). opts (NULL: the defaults) are the omp_kmeans() options the runs
+ * will use: the reduction mode, the number of shards and whether objects
+ * are reordered (and weighted) decide which buffers the arena holds. Each
+ * thread first-touches its own accumulators here.
+ */
+kmeans_ctx* kmeans_ctx_create(int maxObjs, int maxClusters, int maxCoords, int maxThreads,
+                              const kmeans_opts *opts) {
+    if (maxObjs <= 0 || maxClusters <= 1 || maxCoords <= 0) return NULL;
+    if (maxThreads <= 0) maxThreads = omp_get_max_threads();
+
+    kmeans_ctx *ctx = (kmeans_ctx*) malloc(sizeof(kmeans_ctx));
+    if (ctx == NULL) return NULL;
+
+    size_t wsBytes     = omp_kmeans_workspace(&ctx->ws, NULL, maxObjs, maxClusters, maxCoords,
+                                              maxThreads, opts);
+    size_t centerBytes = PAD_TO_LINE((size_t)maxClusters * maxCoords * sizeof(float));
+
+    void *arena = NULL;
+    if (posix_memalign(&arena, CACHE_LINE, wsBytes + centerBytes) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->arena        = (char*) arena;
+    ctx->maxObjs      = maxObjs;
+    ctx->maxClusters  = maxClusters;
+    ctx->maxCoords    = maxCoords;
+    ctx->maxThreads   = maxThreads;
+    ctx->lastCenters  = (float*) (ctx->arena + wsBytes);
+    ctx->lastClusters = ctx->lastCoords = 0;
+
+    /* the per-thread blocks lead the arena; clear it before the layout
+     * stores its row pointers
+     */
+    size_t threadStride = ctx->ws.threadStride;
+    size_t threadBytes  = (size_t)maxThreads * threadStride;
+    #pragma omp parallel num_threads(maxThreads)
+    {
+        int tid = omp_get_thread_num();
+        memset(ctx->arena + (size_t)tid * threadStride, 0, threadStride);
+    }
+    memset(ctx->arena + threadBytes, 0, wsBytes + centerBytes - threadBytes);
+
+    omp_kmeans_workspace(&ctx->ws, arena, maxObjs, maxClusters, maxCoords, maxThreads, opts);
+
+    return ctx;
+}
+
+void kmeans_ctx_destroy(kmeans_ctx *ctx) {
+    if (ctx == NULL) return;
+    free(ctx->arena);
+    free(ctx);
+}
+
+/* Cluster numObjs objects with engine KMEANS_CTX_SEQ (seq_kmeans()) or
+ * KMEANS_CTX_OMP (omp_kmeans() with opts, NULL for the defaults).
+ * clusters[] holds the initial centers on entry, unless warmStart is set and
+ * the previous run of this context had the same numClusters and numCoords,
+ * in which case its final centers are used. Returns the number of
+ * iterations, 0 if the problem exceeds the context's limits or opts need
+ * buffers the context was not created for.
+ */
+int kmeans_ctx_run(kmeans_ctx *ctx,
+                   int         engine,
+                   float     **objects,
+                   int         numCoords,
+                   int         numObjs,
+                   int         numClusters,
+                   float       threshold,
+                   int         warmStart,
+                   int        *membership,
+                   float     **clusters,
+                   const kmeans_opts *opts) {
+    if (ctx == NULL || objects == NULL || membership == NULL || clusters == NULL) return 0;
+    if (numObjs > ctx->maxObjs || numClusters > ctx->maxClusters ||
+        numCoords > ctx->maxCoords || numClusters > numObjs) return 0;
+
+    if (warmStart && ctx->lastClusters == numClusters && ctx->lastCoords == numCoords)
+        for (int i = 0; i < numClusters; i++)
+            memcpy(clusters[i], ctx->lastCenters + (size_t)i * numCoords, numCoords * sizeof(float));
+
+    int iterations = (engine == KMEANS_CTX_SEQ)
+                   ? seq_kmeans_run(objects, numCoords, numObjs, numClusters, threshold,
+                                    membership, clusters, ctx->ws.newClusterSize,
+                                    ctx->ws.newClusters[0])
+                   : omp_kmeans_run(objects, numCoords, numObjs, numClusters, threshold,
+                                    membership, clusters, opts, &ctx->ws);
+    if (iterations == 0) return 0;
+
+    for (int i = 0; i < numClusters; i++)
+        memcpy(ctx->lastCenters + (size_t)i * numCoords, clusters[i], numCoords * sizeof(float));
+    ctx->lastClusters = numClusters;
+    ctx->lastCoords   = numCoords;
+
+    return iterations;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+static const char *phase_names[TRACE_NUM_PHASES] =
+    { "assign", "wait", "reduce", "update", "check", "reorder" };
+
+/* Allocate a trace holding the last `capacity` events. The buffer is
+ * allocated and touched here, so recording never allocates or faults.
+ */
+kmeans_trace* trace_create(long capacity) {
+    kmeans_trace *trace = (kmeans_trace*) malloc(sizeof(kmeans_trace));
+    if (trace == NULL) return NULL;
+
+    /* malloc + memset rather than calloc: calloc may hand back lazily
+     * mapped zero pages, which would fault on the first write while timing
+     */
+    trace->events = (kmeans_trace_event*) malloc(capacity * sizeof(kmeans_trace_event));
+    if (trace->events == NULL) {
+        free(trace);
+        return NULL;
+    }
+    memset(trace->events, 0, capacity * sizeof(kmeans_trace_event));
+    trace->capacity = capacity;
+    trace->count    = 0;
+    trace->origin   = omp_get_wtime();
+
+    return trace;
+}
+
+void trace_free(kmeans_trace *trace) {
+    if (trace == NULL) return;
+    free(trace->events);
+    free(trace);
+}
+
+/* Record one phase of one thread; safe to call from any thread. When the
+ * ring is full the oldest events are overwritten. delta is only meaningful
+ * for TRACE_CHECK events (pass a negative value otherwise).
+ */
+void trace_record(kmeans_trace *trace, int phase, int iteration,
+                  double start, double end, double delta) {
+    long slot;
+
+    if (trace == NULL) return;
+
+    #pragma omp atomic capture
+    slot = trace->count++;
+
+    kmeans_trace_event *ev = &trace->events[slot % trace->capacity];
+    ev->start     = start;
+    ev->end       = end;
+    ev->delta     = (float)delta;
+    ev->iteration = iteration;
+    ev->thread    = omp_get_thread_num();
+    ev->phase     = phase;
+}
+
+/* Write the recorded events: Chrome trace-event JSON (load it in
+ * chrome://tracing or Perfetto) if filename ends in ".json", CSV otherwise.
+ * Times are in microseconds since trace_create(). Returns 1 on success.
+ */
+int trace_write(const kmeans_trace *trace, const char *filename) {
+    size_t len    = strlen(filename);
+    int    isJson = (len >= 5 && strcmp(filename + len - 5, ".json") == 0);
+    long   first  = (trace->count > trace->capacity) ? trace->count - trace->capacity : 0;
+    FILE  *fp     = fopen(filename, "w");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: cannot create trace file %s\n", filename);
+        return 0;
+    }
+
+    if (isJson) fprintf(fp, "{\"traceEvents\": [\n");
+    else        fprintf(fp, "iteration,thread,phase,start_us,end_us,delta\n");
+
+    for (long n = first; n < trace->count; n++) {
+        const kmeans_trace_event *ev = &trace->events[n % trace->capacity];
+        double start = (ev->start - trace->origin) * 1e6;
+        double dur   = (ev->end - ev->start) * 1e6;
+
+        if (isJson) {
+            fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"iteration\": %d",
+                    (n == first) ? "" : ",\n", phase_names[ev->phase], ev->thread,
+                    start, dur, ev->iteration);
+            if (ev->phase == TRACE_CHECK)
+                fprintf(fp, ", \"delta\": %g", ev->delta);
+            fprintf(fp, "}}");
+        } else {
+            fprintf(fp, "%d,%d,%s,%.3f,%.3f,", ev->iteration, ev->thread,
+                    phase_names[ev->phase], start, start + dur);
+            if (ev->phase == TRACE_CHECK) fprintf(fp, "%g", ev->delta);
+            fprintf(fp, "\n");
+        }
+    }
+
+    if (isJson) fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    if (trace->count > trace->capacity)
+        fprintf(stderr, "Warning: trace buffer wrapped, only the last %ld of %ld events kept\n",
+                trace->capacity, trace->count);
+
+    return 1;
+}
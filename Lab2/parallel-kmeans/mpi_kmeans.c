@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+__inline static int find_nearest_cluster(int numClusters,
+                                         int numCoords,
+                                         float *object,
+                                         float **clusters) {
+    int   index    = 0;
+    float min_dist = euclid_dist_2(numCoords, object, clusters[0]);
+
+    for (int i = 1; i < numClusters; i++) {
+        float dist = euclid_dist_2(numCoords, object, clusters[i]);
+        if (dist < min_dist) {
+            min_dist = dist;
+            index    = i;
+        }
+    }
+
+    return index;
+}
+
+/* Distributed k-means: every rank holds numObjs objects of its own (its slab
+ * of the data set) and the same clusters[]. Each iteration assigns the local
+ * objects with OpenMP, then combines the cluster sums, sizes and the number
+ * of membership changes of all ranks with MPI_Allreduce, so every rank
+ * recomputes identical centers. Sums are kept in double so the result
+ * hardly depends on how the data set is split; like omp_kmeans() with
+ * KMEANS_REDUCE_REPRO, not like the float sums of seq_kmeans(), which can
+ * converge to a different partition.
+ */
+int mpi_kmeans(float  **objects,
+               int      numCoords,
+               int      numObjs,
+               int      numClusters,
+               float    threshold,
+               int     *membership,
+               float  **clusters,
+               MPI_Comm comm) {
+    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+
+    size_t  len      = (size_t)numClusters * numCoords;
+    int    *newSize  = (int*)    malloc(numClusters * sizeof(int));
+    double *newSum   = (double*) malloc(len * sizeof(double));
+    long    totalObjs, localObjs = numObjs;
+    if (newSize == NULL || newSum == NULL) {
+        free(newSize);
+        free(newSum);
+        return 0;
+    }
+
+    MPI_Allreduce(&localObjs, &totalObjs, 1, MPI_LONG, MPI_SUM, comm);
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numObjs; i++)
+        membership[i] = -1;
+
+    int    loop = 0;
+    double delta;
+
+    do {
+        delta = 0.0;
+        memset(newSize, 0, numClusters * sizeof(int));
+        memset(newSum, 0, len * sizeof(double));
+
+        /* assign the local slab; OpenMP privatizes and reduces the arrays */
+        #pragma omp parallel for schedule(static) reduction(+:delta) \
+                reduction(+:newSize[:numClusters]) reduction(+:newSum[:len])
+        for (int i = 0; i < numObjs; i++) {
+            int index = find_nearest_cluster(numClusters, numCoords, objects[i], clusters);
+
+            if (membership[i] != index) delta += 1.0;
+            membership[i] = index;
+
+            newSize[index]++;
+            for (int j = 0; j < numCoords; j++)
+                newSum[(size_t)index * numCoords + j] += objects[i][j];
+        }
+
+        /* combine the contributions of all ranks */
+        MPI_Allreduce(MPI_IN_PLACE, newSize, numClusters, MPI_INT,    MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, newSum,  (int)len,    MPI_DOUBLE, MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, &delta,  1,           MPI_DOUBLE, MPI_SUM, comm);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numClusters; i++) {
+            if (newSize[i] == 0) continue;
+            for (int j = 0; j < numCoords; j++)
+                clusters[i][j] = (float)(newSum[(size_t)i * numCoords + j] / newSize[i]);
+        }
+
+        /* fraction of all objects that changed membership this iteration */
+        delta /= totalObjs;
+    } while (delta > threshold && loop++ < 500);
+
+    free(newSize);
+    free(newSum);
+
+    return loop + 1;
+}
+
+/* Read this rank's slab of the data set: objects [*offset, *offset + *numObjs)
+ * out of *totalObjs. Binary files are read collectively with MPI-IO, each rank
+ * fetching only its own byte range. ASCII files cannot be indexed by object,
+ * so every rank parses the file and keeps its slab.
+ */
+float** mpi_read(int      isBinaryFile,
+                 char    *filename,
+                 int     *numObjs,
+                 int     *numCoords,
+                 int     *totalObjs,
+                 int     *offset,
+                 MPI_Comm comm) {
+    int rank, nprocs, header[2];
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    if (!isBinaryFile) {
+        float **all = file_read(0, filename, totalObjs, numCoords);
+        if (all == NULL) return NULL;
+
+        *offset  = (int)((long)*totalObjs * rank / nprocs);
+        *numObjs = (int)((long)*totalObjs * (rank + 1) / nprocs) - *offset;
+
+        float **objects = (float**) malloc((*numObjs > 0 ? *numObjs : 1) * sizeof(float*));
+        assert(objects != NULL);
+        objects[0] = (float*) malloc(((size_t)*numObjs * *numCoords + 1) * sizeof(float));
+        assert(objects[0] != NULL);
+        for (int i = 1; i < *numObjs; i++)
+            objects[i] = objects[i - 1] + *numCoords;
+        if (*numObjs > 0)
+            memcpy(objects[0], all[*offset], (size_t)*numObjs * *numCoords * sizeof(float));
+
+        free(all[0]);
+        free(all);
+        return objects;
+    }
+
+    MPI_File fh;
+    if (MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return NULL;
+    }
+
+    /* header: numObjs and numCoords, both 4-byte integers */
+    MPI_Status status;
+    int        count = 0;
+    if (MPI_File_read_at_all(fh, 0, header, 2, MPI_INT, &status) != MPI_SUCCESS ||
+        MPI_Get_count(&status, MPI_INT, &count) != MPI_SUCCESS || count != 2 ||
+        header[0] <= 0 || header[1] <= 0) {
+        if (rank == 0) fprintf(stderr, "Error: %s is not a binary data file\n", filename);
+        MPI_File_close(&fh);
+        return NULL;
+    }
+    *totalObjs = header[0];
+    *numCoords = header[1];
+    if (_debug && rank == 0) {
+        printf("File %s numObjs   = %d\n", filename, *totalObjs);
+        printf("File %s numCoords = %d\n", filename, *numCoords);
+    }
+
+    *offset  = (int)((long)*totalObjs * rank / nprocs);
+    *numObjs = (int)((long)*totalObjs * (rank + 1) / nprocs) - *offset;
+
+    float **objects = (float**) malloc((*numObjs > 0 ? *numObjs : 1) * sizeof(float*));
+    assert(objects != NULL);
+    objects[0] = (float*) malloc(((size_t)*numObjs * *numCoords + 1) * sizeof(float));
+    assert(objects[0] != NULL);
+    for (int i = 1; i < *numObjs; i++)
+        objects[i] = objects[i - 1] + *numCoords;
+
+    MPI_Offset disp = (MPI_Offset)sizeof(header) +
+                      (MPI_Offset)*offset * *numCoords * sizeof(float);
+    /* a header claiming more objects than the file holds shows up as a
+     * short read of some rank's slab
+     */
+    if (MPI_File_read_at_all(fh, disp, objects[0], *numObjs * *numCoords, MPI_FLOAT,
+                             &status) != MPI_SUCCESS ||
+        MPI_Get_count(&status, MPI_FLOAT, &count) != MPI_SUCCESS ||
+        count != *numObjs * *numCoords) {
+        fprintf(stderr, "Error: %s is truncated (rank %d read %d of %d values)\n",
+                filename, rank, count, *numObjs * *numCoords);
+        MPI_File_close(&fh);
+        free(objects[0]);
+        free(objects);
+        return NULL;
+    }
+    MPI_File_close(&fh);
+
+    return objects;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mpi.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+int _debug;
+
+static void usage(char *argv0, float threshold) {
+    char *help =
+        "Usage: mpirun -np N %s [switches] -i filename -n num_clusters\n"
+        "       -i filename    : file containing data to be clustered\n"
+        "       -c centers     : file containing initial centers (default: filename)\n"
+        "       -b             : input file is in binary format (default: no)\n"
+        "       -n num_clusters: number of clusters (K must > 1)\n"
+        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -p nproc       : number of OpenMP threads per rank (default: runtime)\n"
+        "       -o             : output timing results (default: no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, threshold);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+}
+
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+    extern int     optind;
+           int     i, j, numThreads, isBinaryFile, is_output_timing, verbose;
+           int     rank, nprocs, provided;
+
+           int     numClusters, numCoords, numObjs, totalObjs, offset;
+           int    *membership, *allMembership, *counts, *displs;
+           char   *filename, *center_filename;
+           float **objects;
+           float **clusters;
+           float   threshold;
+           double  timing, io_timing, clustering_timing;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    _debug             = 0;
+    verbose            = 1;
+    threshold          = 0.001f;
+    numClusters        = 0;
+    isBinaryFile       = 0;
+    is_output_timing   = 0;
+    filename           = NULL;
+    center_filename    = NULL;
+    numThreads         = 0;
+
+    while ((opt = getopt(argc, argv, "p:i:c:n:t:bdohq")) != EOF) {
+        switch (opt) {
+            case 'p':
+                numThreads = atoi(optarg);
+                break;
+            case 'i':
+                filename = optarg;
+                break;
+            case 'c':
+                center_filename = optarg;
+                break;
+            case 'b':
+                isBinaryFile = 1;
+                break;
+            case 't':
+                threshold = (float)atof(optarg);
+                break;
+            case 'n':
+                numClusters = atoi(optarg);
+                break;
+            case 'o':
+                is_output_timing = 1;
+                break;
+            case 'q':
+                verbose = 0;
+                break;
+            case 'd':
+                _debug = 1;
+                break;
+            case 'h':
+            default:
+                usage(argv[0], threshold);
+                break;
+        }
+    }
+    if (center_filename == NULL)
+        center_filename = filename;
+
+    if (filename == NULL || numClusters <= 1) usage(argv[0], threshold);
+
+    if (numThreads > 0) {
+        omp_set_num_threads(numThreads);
+    }
+
+    if (is_output_timing) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        io_timing = MPI_Wtime();
+    }
+
+    if (rank == 0) printf("reading data points from file %s\n", filename);
+
+    objects = mpi_read(isBinaryFile, filename, &numObjs, &numCoords, &totalObjs, &offset,
+                       MPI_COMM_WORLD);
+    if (objects == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (totalObjs < numClusters) {
+        if (rank == 0)
+            printf("Error: number of clusters must be larger than the number of data points to be clustered.\n");
+        free(objects[0]);
+        free(objects);
+        MPI_Finalize();
+        return 1;
+    }
+
+    clusters    = (float**) malloc(numClusters * sizeof(float*));
+    assert(clusters != NULL);
+    clusters[0] = (float*)  malloc((size_t)numClusters * numCoords * sizeof(float));
+    assert(clusters[0] != NULL);
+    for (i = 1; i < numClusters; i++)
+        clusters[i] = clusters[i - 1] + numCoords;
+
+    /* rank 0 reads the first numClusters objects (of the data set or of the
+     * -c file) and every rank starts from the same copy
+     */
+    int ok = 1;
+    if (rank == 0) {
+        if (center_filename != filename)
+            printf("reading initial %d centers from file %s\n", numClusters, center_filename);
+        else
+            printf("selecting the first %d elements as initial centers\n", numClusters);
+        ok = read_n_objects(isBinaryFile, center_filename, numClusters, numCoords, clusters);
+
+        /* also sorts the centers, giving the same cluster ids as seq_main */
+        if (ok && check_repeated_clusters(numClusters, numCoords, clusters) == 0) {
+            printf("Error: some initial clusters are repeated. Please select distinct initial centers\n");
+            ok = 0;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) MPI_Abort(MPI_COMM_WORLD, 1);
+    MPI_Bcast(clusters[0], numClusters * numCoords, MPI_FLOAT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0 && _debug) {
+        printf("Sorted initial cluster centers:\n");
+        for (i = 0; i < numClusters; i++) {
+            printf("clusters[%d]=", i);
+            for (j = 0; j < numCoords; j++)
+                printf(" %6.2f", clusters[i][j]);
+            printf("\n");
+        }
+    }
+
+    if (is_output_timing) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        timing            = MPI_Wtime();
+        io_timing         = timing - io_timing;
+        clustering_timing = timing;
+    }
+
+    membership = (int*) malloc(((size_t)numObjs + 1) * sizeof(int));
+    assert(membership != NULL);
+
+    if (!mpi_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                    membership, clusters, MPI_COMM_WORLD)) {
+        fprintf(stderr, "Error: mpi_kmeans failed on rank %d\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    free(objects[0]);
+    free(objects);
+
+    if (is_output_timing) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        timing            = MPI_Wtime();
+        clustering_timing = timing - clustering_timing;
+    }
+
+    /* collect the slabs' memberships, in object order, on rank 0 */
+    allMembership = NULL;
+    counts        = NULL;
+    displs        = NULL;
+    if (rank == 0) {
+        allMembership = (int*) malloc((size_t)totalObjs * sizeof(int));
+        counts        = (int*) malloc(nprocs * sizeof(int));
+        displs        = (int*) malloc(nprocs * sizeof(int));
+        assert(allMembership != NULL && counts != NULL && displs != NULL);
+    }
+    MPI_Gather(&numObjs, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&offset,  1, MPI_INT, displs, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(membership, numObjs, MPI_INT, allMembership, counts, displs, MPI_INT,
+                0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+        file_write(filename, numClusters, totalObjs, numCoords, clusters,
+                   allMembership, verbose);
+
+    free(allMembership);
+    free(counts);
+    free(displs);
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+
+    if (is_output_timing && rank == 0) {
+        io_timing += MPI_Wtime() - timing;
+        printf("\nPerforming **** Regular Kmeans (MPI+OpenMP version) ****\n");
+        printf("Input file:     %s\n", filename);
+        printf("numObjs       = %d\n", totalObjs);
+        printf("numCoords     = %d\n", numCoords);
+        printf("numClusters   = %d\n", numClusters);
+        printf("threshold     = %.4f\n", threshold);
+        printf("Processes     = %d\n", nprocs);
+        printf("Threads       = %d\n", (numThreads > 0) ? numThreads : omp_get_max_threads());
+
+        printf("I/O time           = %10.4f sec\n", io_timing);
+        printf("Computation timing = %10.4f sec\n", clustering_timing);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* relative slack on the candidate radius; covers the rounding of the fp32
+ * reference distances and of the bf16 screening distances themselves
+ */
+#define BF16_SLACK 1e-3f
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+/* fp32 -> bf16 with round-to-nearest-even (inputs are finite) */
+__inline static uint16_t float_to_bf16(float f) {
+    uint32_t bits;
+
+    memcpy(&bits, &f, sizeof(bits));
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+
+    return (uint16_t)(bits >> 16);
+}
+
+/* bf16 -> fp32 is exact: the bf16 bits are the top half of the float */
+__inline static float bf16_to_float(uint16_t h) {
+    uint32_t bits = (uint32_t)h << 16;
+    float    f;
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/* Nearest cluster of one object, screened in reduced precision.
+ * obj16 is the bf16 copy x' of the object x and err = |x - x'|. By the
+ * triangle inequality |x - c| and |x' - c| differ by at most err, so the
+ * true nearest center c* satisfies |x' - c*| <= min_c |x' - c| + 2 err.
+ * Only when more than one center lies within that radius are the candidates
+ * compared again in fp32, with the same kernel and index order as the fp32
+ * engine; otherwise the screening winner is provably its answer too.
+ */
+__inline static int find_nearest_cluster_bf16(int       numClusters,
+                                              int       numCoords,
+                                              uint16_t *obj16,
+                                              float     err,
+                                              float    *object,
+                                              float   **clusters,
+                                              float    *wide,   /* [numCoords] scratch */
+                                              long     *rechecks) {
+    for (int j = 0; j < numCoords; j++)
+        wide[j] = bf16_to_float(obj16[j]);
+
+    /* screening pass: nearest and second nearest center of x' */
+    int   index    = 0;
+    float min_dist = euclid_dist_2(numCoords, wide, clusters[0]);
+    float second   = 3.402823466e+38f;
+
+    for (int i = 1; i < numClusters; i++) {
+        float dist = euclid_dist_2(numCoords, wide, clusters[i]);
+        if (dist < min_dist) {
+            second   = min_dist;
+            min_dist = dist;
+            index    = i;
+        } else if (dist < second)
+            second = dist;
+    }
+
+    float radius = (sqrtf(min_dist) + 2.0f * err) * (1.0f + BF16_SLACK) + 1e-6f;
+    float bound  = radius * radius;
+
+    if (second > bound) return index;
+
+    /* near-tie: exact fp32 re-check of the candidates only (the screening
+     * distances are recomputed, which is cheaper than storing them all)
+     */
+    (*rechecks)++;
+    index    = -1;
+    min_dist = 0.0f;
+    for (int i = 0; i < numClusters; i++) {
+        if (euclid_dist_2(numCoords, wide, clusters[i]) > bound) continue;
+
+        float d = euclid_dist_2(numCoords, object, clusters[i]);
+        if (index < 0 || d < min_dist) {
+            min_dist = d;
+            index    = i;
+        }
+    }
+
+    return index;
+}
+
+/* Lloyd's k-means with the assignment step run on a bf16 copy of objects[],
+ * halving the bytes streamed per iteration. Memberships equal those of the
+ * fp32 kernel for the same centers (see find_nearest_cluster_bf16()).
+ * Because the update step must not stream the fp32 objects again, cluster
+ * sums are kept in double across iterations and corrected only for the
+ * objects that changed membership.
+ */
+int omp_bf16_kmeans(float **objects,
+                    int     numCoords,
+                    int     numObjs,
+                    int     numClusters,
+                    float   threshold,
+                    int    *membership,
+                    float **clusters) {
+    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+
+    size_t len        = (size_t)numClusters * numCoords;
+    int    maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    int    loop = 0, done = 0, allocFailed = 0;
+    long   rechecks = 0;
+    double delta = 0.0;
+
+    uint16_t *objs16      = (uint16_t*) malloc((size_t)numObjs * numCoords * sizeof(uint16_t));
+    float    *objErr      = (float*)    malloc((size_t)numObjs * sizeof(float));
+    double   *clusterSum  = (double*)   calloc(len, sizeof(double));
+    int      *clusterSize = (int*)      calloc(numClusters, sizeof(int));
+    double  **threadSum   = (double**)  calloc(maxThreads, sizeof(double*));
+    if (objs16 == NULL || objErr == NULL || clusterSum == NULL || clusterSize == NULL ||
+        threadSum == NULL) {
+        free(objs16);
+        free(objErr);
+        free(clusterSum);
+        free(clusterSize);
+        free(threadSum);
+        return 0;
+    }
+
+    #pragma omp parallel shared(nthreads, delta, done, loop, allocFailed) reduction(+:rechecks)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        /* per-thread block, first touched by its owner: the sum and count
+         * corrections of this iteration, then the widening scratch
+         */
+        size_t sumBytes  = PAD_TO_LINE(len * sizeof(double));
+        size_t sizeBytes = PAD_TO_LINE((size_t)numClusters * sizeof(int));
+        size_t tmpBytes  = PAD_TO_LINE((size_t)numCoords * sizeof(float));
+        void  *block     = NULL;
+        if (posix_memalign(&block, CACHE_LINE, sumBytes + sizeBytes + tmpBytes) != 0) {
+            #pragma omp atomic write
+            allocFailed = 1;
+            block = NULL;
+        }
+        threadSum[tid] = (double*) block;
+
+        double *localSum  = (double*) block;
+        int    *localSize = (int*)   ((char*) block + sumBytes);
+        float  *wide      = (float*) ((char*) block + sumBytes + sizeBytes);
+
+        /* quantize once; err is rounded up so it stays a valid bound */
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++) {
+            double err = 0.0;
+            for (int j = 0; j < numCoords; j++) {
+                uint16_t h = float_to_bf16(objects[i][j]);
+                double   d = (double)objects[i][j] - bf16_to_float(h);
+
+                objs16[(size_t)i * numCoords + j] = h;
+                err += d * d;
+            }
+            objErr[i]     = (float)(sqrt(err) * (1.0 + 1e-6));
+            membership[i] = -1;
+        }
+
+        #pragma omp single
+        {
+            if (allocFailed) done = 1;
+        }
+
+        while (!done) {
+            memset(localSum, 0, len * sizeof(double));
+            memset(localSize, 0, numClusters * sizeof(int));
+
+            /* Phase 1: assign; only objects that move touch their fp32 data */
+            #pragma omp for schedule(static) reduction(+:delta)
+            for (int i = 0; i < numObjs; i++) {
+                int index = find_nearest_cluster_bf16(numClusters, numCoords,
+                                                      objs16 + (size_t)i * numCoords,
+                                                      objErr[i], objects[i], clusters,
+                                                      wide, &rechecks);
+                int old   = membership[i];
+                if (old == index) continue;
+
+                delta += 1.0;
+                membership[i] = index;
+
+                double *dst = localSum + (size_t)index * numCoords;
+                localSize[index]++;
+                for (int j = 0; j < numCoords; j++)
+                    dst[j] += objects[i][j];
+
+                if (old >= 0) {
+                    double *src = localSum + (size_t)old * numCoords;
+                    localSize[old]--;
+                    for (int j = 0; j < numCoords; j++)
+                        src[j] -= objects[i][j];
+                }
+            }
+
+            /* Phase 2: fold the corrections into the running sums, recompute */
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numClusters; i++) {
+                double *sum = clusterSum + (size_t)i * numCoords;
+
+                for (int t = 0; t < nthreads; t++) {
+                    double *src  = threadSum[t] + (size_t)i * numCoords;
+                    int    *size = (int*) ((char*) threadSum[t] + sumBytes);
+
+                    clusterSize[i] += size[i];
+                    for (int j = 0; j < numCoords; j++)
+                        sum[j] += src[j];
+                }
+
+                if (clusterSize[i] > 0)
+                    for (int j = 0; j < numCoords; j++)
+                        clusters[i][j] = (float)(sum[j] / clusterSize[i]);
+            }
+
+            /* Phase 3: convergence check */
+            #pragma omp single
+            {
+                delta /= numObjs;
+                done   = !(delta > threshold && loop++ < 500);
+                delta  = 0.0;
+            }
+        }
+
+        free(block);
+    }
+
+    if (_debug)
+        printf("bf16 screening: %ld fp32 re-checks in %d iterations\n", rechecks, loop + 1);
+
+    free(objs16);
+    free(objErr);
+    free(clusterSum);
+    free(clusterSize);
+    free(threadSum);
+
+    return allocFailed ? 0 : loop + 1;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* FNV-1a over the coordinates' bit patterns */
+__inline static uint64_t hash_object(const float *obj, int numCoords) {
+    uint64_t h = 1469598103934665603ULL;
+
+    for (int j = 0; j < numCoords; j++) {
+        uint32_t bits;
+        memcpy(&bits, &obj[j], sizeof(bits));
+        h ^= bits;
+        h *= 1099511628211ULL;
+    }
+
+    return h ^ (h >> 29);
+}
+
+/* Collapse identical objects (bitwise equal coordinates) into weighted
+ * distinct objects. Objects are inserted into an open-addressing hash table
+ * in parallel; each slot keeps the lowest index of its objects, so the
+ * distinct set comes out in order of first occurrence whatever the thread
+ * count. On return map[i] (numObjs ints, caller allocated) is the distinct
+ * object of objects[i] and (*weights)[d] the multiplicity of distinct object d.
+ * Returns the distinct objects in the same layout as file_read(), or NULL if
+ * memory runs out.
+ */
+float** coreset_collapse(float **objects,
+                         int     numCoords,
+                         int     numObjs,
+                         int    *numDistinct,
+                         int   **weights,
+                         int    *map) {
+    size_t   bytes      = (size_t)numCoords * sizeof(float);
+    size_t   capacity   = 2;
+    int      maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    float  **distinct   = NULL;
+
+    while (capacity < 2 * (size_t)numObjs) capacity *= 2;
+
+    int  *table      = (int*)  malloc(capacity * sizeof(int));
+    char *first      = (char*) malloc((size_t)numObjs);
+    int  *threadBase = (int*)  malloc(((size_t)maxThreads + 1) * sizeof(int));
+    if (table == NULL || first == NULL || threadBase == NULL) {
+        free(table);
+        free(first);
+        free(threadBase);
+        return NULL;
+    }
+    *weights     = NULL;
+    *numDistinct = 0;
+
+    #pragma omp parallel shared(nthreads, distinct)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        #pragma omp for schedule(static)
+        for (size_t s = 0; s < capacity; s++)
+            table[s] = -1;
+
+        /* insert; map[i] temporarily holds the slot of object i */
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++) {
+            size_t mask = capacity - 1;
+            size_t s    = hash_object(objects[i], numCoords) & mask;
+
+            for (;;) {
+                int cur = __atomic_load_n(&table[s], __ATOMIC_ACQUIRE);
+
+                if (cur < 0) {
+                    if (__atomic_compare_exchange_n(&table[s], &cur, i, 0,
+                                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                        break;
+                    continue;  /* lost the race, look at the winner */
+                }
+                if (memcmp(objects[cur], objects[i], bytes) == 0) {
+                    /* same point: the slot keeps the lowest index */
+                    if (i < cur && !__atomic_compare_exchange_n(&table[s], &cur, i, 0,
+                                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                        continue;
+                    break;
+                }
+                s = (s + 1) & mask;
+            }
+            map[i] = (int)s;
+        }
+
+        /* number the first occurrences in object order: count per thread
+         * chunk, scan, then number within the chunk (same static chunks)
+         */
+        int count = 0;
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++) {
+            first[i] = (table[map[i]] == i);
+            count   += first[i];
+        }
+        threadBase[tid + 1] = count;
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            threadBase[0] = 0;
+            for (int t = 0; t < nthreads; t++)
+                threadBase[t + 1] += threadBase[t];
+            *numDistinct = threadBase[nthreads];
+
+            distinct = (float**) malloc((*numDistinct > 0 ? *numDistinct : 1) * sizeof(float*));
+            *weights = (int*)    calloc(*numDistinct > 0 ? *numDistinct : 1, sizeof(int));
+            if (distinct != NULL) {
+                distinct[0] = (float*) malloc(((size_t)*numDistinct * numCoords + 1) * sizeof(float));
+                if (distinct[0] == NULL) {
+                    free(distinct);
+                    distinct = NULL;
+                }
+            }
+            if (distinct != NULL)
+                for (int d = 1; d < *numDistinct; d++)
+                    distinct[d] = distinct[d - 1] + numCoords;
+        }
+
+        if (distinct != NULL && *weights != NULL) {
+            /* copy the first occurrences and store their ids in the table */
+            int id = threadBase[tid];
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++) {
+                if (!first[i]) continue;
+                memcpy(distinct[id], objects[i], bytes);
+                table[map[i]] = id++;
+            }
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++) {
+                map[i] = table[map[i]];
+                #pragma omp atomic
+                (*weights)[map[i]]++;
+            }
+        }
+    }
+
+    free(table);
+    free(first);
+    free(threadBase);
+
+    if (distinct == NULL || *weights == NULL) {
+        if (distinct != NULL) {
+            free(distinct[0]);
+            free(distinct);
+        }
+        free(*weights);
+        *weights = NULL;
+        return NULL;
+    }
+
+    return distinct;
+}
@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define KD_LEAF_SIZE   16    /* max. objects in a leaf */
+#define KD_TASK_CUTOFF 4096  /* subtrees smaller than this are not split into tasks */
+#define KD_STACK_CANDS 512   /* task nodes' candidate lists up to this size live on the stack */
+
+/* relative slack of the pruning test, so a center is only dropped when the
+ * fp32 kernel of plain Lloyd would not pick it either
+ */
+#define KD_SLACK 1e-5f
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+/* A kd-tree node covers the objects idx[start .. start+count); its tight
+ * bounding box and coordinate sum are stored in kd_tree.box/sum.
+ */
+typedef struct {
+    int start, count;
+    int left, right;              /* child node ids, -1 for a leaf */
+} kd_node;
+
+typedef struct {
+    float  **objects;
+    int      numCoords;
+    int      numClusters;
+    int     *idx;                 /* permutation of object ids */
+    kd_node *nodes;
+    float   *box;                 /* [maxNodes][2][numCoords]: lo, then hi */
+    double  *sum;                 /* [maxNodes][numCoords] */
+    int      numNodes;
+    int      depth;               /* levels of the tree, root only = 1 */
+
+    /* per-iteration state of the filtering pass */
+    float  **clusters;
+    int     *membership;
+    double **threadSum;           /* [nthreads] -> [numClusters][numCoords] */
+    long   **threadSize;          /* [nthreads] -> [numClusters] + changed count */
+    int    **threadCand;          /* [nthreads] -> [depth][numClusters] */
+    int      failed;              /* a task node's candidate list could not be allocated */
+} kd_tree;
+
+/* Compute the box and sum of a node from its objects, split it at the
+ * midpoint of its widest dimension and recurse; large subtrees become tasks.
+ */
+static void kd_build(kd_tree *tree, int node, int start, int count) {
+    int     numCoords = tree->numCoords;
+    float  *lo        = tree->box + (size_t)node * 2 * numCoords;
+    float  *hi        = lo + numCoords;
+    double *sum       = tree->sum + (size_t)node * numCoords;
+    int    *idx       = tree->idx;
+
+    kd_node *n = &tree->nodes[node];
+    n->start = start;
+    n->count = count;
+    n->left  = n->right = -1;
+
+    for (int j = 0; j < numCoords; j++) {
+        lo[j]  = hi[j] = tree->objects[idx[start]][j];
+        sum[j] = 0.0;
+    }
+    for (int i = start; i < start + count; i++) {
+        float *obj = tree->objects[idx[i]];
+        for (int j = 0; j < numCoords; j++) {
+            if (obj[j] < lo[j]) lo[j] = obj[j];
+            if (obj[j] > hi[j]) hi[j] = obj[j];
+            sum[j] += obj[j];
+        }
+    }
+    if (count <= KD_LEAF_SIZE) return;
+
+    int dim = 0;
+    for (int j = 1; j < numCoords; j++)
+        if (hi[j] - lo[j] > hi[dim] - lo[dim]) dim = j;
+    if (hi[dim] <= lo[dim]) return;  /* all objects identical */
+
+    /* the box is tight, so both sides of the midpoint are non-empty */
+    float mid = 0.5f * (lo[dim] + hi[dim]);
+    int   i = start, k = start + count - 1;
+    while (i <= k) {
+        if (tree->objects[idx[i]][dim] < mid) i++;
+        else {
+            int tmp = idx[i];
+            idx[i]  = idx[k];
+            idx[k--] = tmp;
+        }
+    }
+    int numLeft = i - start;
+    if (numLeft == 0 || numLeft == count) return;
+
+    int left;
+    #pragma omp atomic capture
+    { left = tree->numNodes; tree->numNodes += 2; }
+    n->left  = left;
+    n->right = left + 1;
+
+    if (count > KD_TASK_CUTOFF) {
+        #pragma omp task firstprivate(tree, left, start, numLeft)
+        kd_build(tree, left, start, numLeft);
+        #pragma omp task firstprivate(tree, left, start, numLeft, count)
+        kd_build(tree, left + 1, start + numLeft, count - numLeft);
+    } else {
+        kd_build(tree, left, start, numLeft);
+        kd_build(tree, left + 1, start + numLeft, count - numLeft);
+    }
+}
+
+/* number of levels of the subtree under node */
+static int kd_depth(const kd_tree *tree, int node) {
+    const kd_node *n = &tree->nodes[node];
+    int            l, r;
+
+    if (n->left < 0) return 1;
+    l = kd_depth(tree, n->left);
+    r = kd_depth(tree, n->right);
+    return 1 + ((l > r) ? l : r);
+}
+
+/* Kanungo et al.'s test: is every point of the box strictly farther from z
+ * than from zstar? Only the box vertex furthest in the direction z - zstar
+ * needs checking.
+ */
+__inline static int kd_prunable(int numCoords, float *lo, float *hi, float *z, float *zstar) {
+    float dz = 0.0f, dstar = 0.0f;
+
+    for (int j = 0; j < numCoords; j++) {
+        float v  = (z[j] > zstar[j]) ? hi[j] : lo[j];
+        float a  = v - z[j], b = v - zstar[j];
+        dz      += a * a;
+        dstar   += b * b;
+    }
+
+    return dz > dstar * (1.0f + KD_SLACK);
+}
+
+/* Filtering pass over a subtree at level depth with candidate centers
+ * cand[0..numCand), kept in ascending order so ties resolve to the lowest
+ * index as in Lloyd.
+ */
+static void kd_filter(kd_tree *tree, int node, int depth, const int *cand, int numCand) {
+    int      numCoords = tree->numCoords;
+    kd_node *n         = &tree->nodes[node];
+    float  **clusters  = tree->clusters;
+    int      tid       = omp_get_thread_num();
+    double  *accSum    = tree->threadSum[tid];
+    long    *accSize   = tree->threadSize[tid];
+
+    /* one candidate left: the whole subtree belongs to it */
+    if (numCand == 1) {
+        int     c   = cand[0];
+        double *sum = tree->sum + (size_t)node * numCoords;
+
+        accSize[c] += n->count;
+        for (int j = 0; j < numCoords; j++)
+            accSum[(size_t)c * numCoords + j] += sum[j];
+        for (int i = n->start; i < n->start + n->count; i++) {
+            int obj = tree->idx[i];
+            if (tree->membership[obj] != c) {
+                tree->membership[obj] = c;
+                accSize[tree->numClusters]++;
+            }
+        }
+        return;
+    }
+
+    /* leaf: brute force over the surviving candidates */
+    if (n->left < 0) {
+        for (int i = n->start; i < n->start + n->count; i++) {
+            int    obj      = tree->idx[i];
+            int    index    = cand[0];
+            float  min_dist = euclid_dist_2(numCoords, tree->objects[obj], clusters[index]);
+
+            for (int k = 1; k < numCand; k++) {
+                float dist = euclid_dist_2(numCoords, tree->objects[obj], clusters[cand[k]]);
+                if (dist < min_dist) {
+                    min_dist = dist;
+                    index    = cand[k];
+                }
+            }
+
+            if (tree->membership[obj] != index) {
+                tree->membership[obj] = index;
+                accSize[tree->numClusters]++;
+            }
+            accSize[index]++;
+            for (int j = 0; j < numCoords; j++)
+                accSum[(size_t)index * numCoords + j] += tree->objects[obj][j];
+        }
+        return;
+    }
+
+    /* internal node: keep the center closest to the box midpoint and every
+     * center that is not dominated by it over the whole box
+     */
+    float *lo = tree->box + (size_t)node * 2 * numCoords;
+    float *hi = lo + numCoords;
+    int    zstar = cand[0];
+    float  best  = -1.0f;
+    for (int k = 0; k < numCand; k++) {
+        float d = 0.0f;
+        for (int j = 0; j < numCoords; j++) {
+            float diff = 0.5f * (lo[j] + hi[j]) - clusters[cand[k]][j];
+            d += diff * diff;
+        }
+        if (best < 0.0f || d < best) {
+            best  = d;
+            zstar = cand[k];
+        }
+    }
+
+    /* Below the task cutoff a subtree runs start to finish on one thread
+     * with no task scheduling point, so its lists go to that thread's
+     * scratch row of the level. A task node's list is read by its child
+     * tasks on other threads while this thread may run a sibling task of
+     * the same level at the taskwait, so it gets storage of its own; there
+     * are only a few such nodes near the root.
+     */
+    int  stackCand[KD_STACK_CANDS];
+    int *next    = tree->threadCand[tid] + (size_t)depth * tree->numClusters;
+    int  numNext = 0;
+    if (n->count > KD_TASK_CUTOFF) {
+        next = (numCand <= KD_STACK_CANDS) ? stackCand : (int*) malloc(numCand * sizeof(int));
+        if (next == NULL) {
+            #pragma omp atomic write
+            tree->failed = 1;
+            return;
+        }
+    }
+    for (int k = 0; k < numCand; k++)
+        if (cand[k] == zstar ||
+            !kd_prunable(numCoords, lo, hi, clusters[cand[k]], clusters[zstar]))
+            next[numNext++] = cand[k];
+
+    if (n->count > KD_TASK_CUTOFF) {
+        #pragma omp task firstprivate(tree, n, depth, next, numNext)
+        kd_filter(tree, n->left, depth + 1, next, numNext);
+        #pragma omp task firstprivate(tree, n, depth, next, numNext)
+        kd_filter(tree, n->right, depth + 1, next, numNext);
+        #pragma omp taskwait
+        if (next != stackCand) free(next);
+    } else {
+        kd_filter(tree, n->left, depth + 1, next, numNext);
+        kd_filter(tree, n->right, depth + 1, next, numNext);
+    }
+}
+
+/* k-means with the kd-tree filtering algorithm (Kanungo et al., 2002).
+ * The tree over objects[] is built once; every iteration then pushes the
+ * candidate centers down the tree, pruning those that cannot be nearest to
+ * any object of a node, and assigns whole subtrees at once using the cached
+ * per-node sums. Worth it for low-dimensional data (up to ~10 coordinates).
+ */
+int omp_kdtree_kmeans(float **objects,
+                      int     numCoords,
+                      int     numObjs,
+                      int     numClusters,
+                      float   threshold,
+                      int    *membership,
+                      float **clusters) {
+    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+
+    int     maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    int     maxNodes   = 2 * numObjs;
+    int     loop = 0, done = 0, allocFailed = 0;
+    long    changed = 0;
+    kd_tree tree;
+
+    tree.objects     = objects;
+    tree.numCoords   = numCoords;
+    tree.numClusters = numClusters;
+    tree.clusters    = clusters;
+    tree.membership  = membership;
+    tree.numNodes    = 1;
+    tree.failed      = 0;
+    tree.idx         = (int*)     malloc((size_t)numObjs * sizeof(int));
+    tree.nodes       = (kd_node*) malloc((size_t)maxNodes * sizeof(kd_node));
+    tree.box         = (float*)   malloc((size_t)maxNodes * 2 * numCoords * sizeof(float));
+    tree.sum         = (double*)  malloc((size_t)maxNodes * numCoords * sizeof(double));
+    tree.threadSum   = (double**) calloc(maxThreads, sizeof(double*));
+    tree.threadSize  = (long**)   calloc(maxThreads, sizeof(long*));
+    tree.threadCand  = (int**)    calloc(maxThreads, sizeof(int*));
+    int *allCand     = (int*)     malloc(numClusters * sizeof(int));
+    if (tree.idx == NULL || tree.nodes == NULL || tree.box == NULL || tree.sum == NULL ||
+        tree.threadSum == NULL || tree.threadSize == NULL || tree.threadCand == NULL ||
+        allCand == NULL) {
+        free(tree.idx);
+        free(tree.nodes);
+        free(tree.box);
+        free(tree.sum);
+        free(tree.threadSum);
+        free(tree.threadSize);
+        free(tree.threadCand);
+        free(allCand);
+        return 0;
+    }
+
+    for (int c = 0; c < numClusters; c++)
+        allCand[c] = c;
+
+    #pragma omp parallel shared(nthreads, done, loop, changed, allocFailed)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++) {
+            tree.idx[i]   = i;
+            membership[i] = -1;
+        }
+
+        /* build the tree; the barrier ending single waits for all tasks */
+        #pragma omp single
+        {
+            kd_build(&tree, 0, 0, numObjs);
+        }
+        #pragma omp single
+        {
+            tree.depth = kd_depth(&tree, 0);
+        }
+
+        /* per-thread sums, sizes and change counter, and a candidate list
+         * per tree level, allocated by the owner
+         */
+        size_t sumBytes  = PAD_TO_LINE((size_t)numClusters * numCoords * sizeof(double));
+        size_t sizeBytes = PAD_TO_LINE(((size_t)numClusters + 1) * sizeof(long));
+        size_t candBytes = (size_t)tree.depth * numClusters * sizeof(int);
+        void  *block     = NULL;
+        if (posix_memalign(&block, CACHE_LINE, sumBytes + sizeBytes + candBytes) != 0) {
+            #pragma omp atomic write
+            allocFailed = 1;
+            block = NULL;
+        }
+        tree.threadSum[tid]  = (double*) block;
+        tree.threadSize[tid] = (long*) ((char*) block + sumBytes);
+        tree.threadCand[tid] = (int*) ((char*) block + sumBytes + sizeBytes);
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            if (allocFailed) done = 1;
+        }
+
+        while (!done) {
+            memset(tree.threadSum[tid], 0, sumBytes);
+            memset(tree.threadSize[tid], 0, sizeBytes);
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                kd_filter(&tree, 0, 0, allCand, numClusters);
+            }
+
+            if (tree.failed) break;
+
+            /* reduce the per-thread accumulators and recompute the centers */
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numClusters; i++) {
+                long size = 0;
+
+                for (int t = 0; t < nthreads; t++)
+                    size += tree.threadSize[t][i];
+                if (size == 0) continue;
+
+                for (int j = 0; j < numCoords; j++) {
+                    double s = 0.0;
+                    for (int t = 0; t < nthreads; t++)
+                        s += tree.threadSum[t][(size_t)i * numCoords + j];
+                    clusters[i][j] = (float)(s / size);
+                }
+            }
+
+            /* convergence check */
+            #pragma omp single
+            {
+                changed = 0;
+                for (int t = 0; t < nthreads; t++)
+                    changed += tree.threadSize[t][numClusters];
+
+                double delta = (double)changed / numObjs;
+                done = !(delta > threshold && loop++ < 500);
+            }
+        }
+
+        free(block);
+    }
+
+    if (_debug)
+        printf("kd-tree: %d nodes, %d iterations\n", tree.numNodes, loop + 1);
+
+    free(tree.idx);
+    free(tree.nodes);
+    free(tree.box);
+    free(tree.sum);
+    free(tree.threadSum);
+    free(tree.threadSize);
+    free(tree.threadCand);
+    free(allCand);
+
+    return (allocFailed || tree.failed) ? 0 : loop + 1;
+}
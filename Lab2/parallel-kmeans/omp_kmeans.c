@@ -34,154 +34,752 @@ __inline static int find_nearest_cluster(int numClusters,
     return index;
 }
 
-// return an array of cluster centers of size [numClusters][numCoords]
-int omp_kmeans(float **objects,
-               int     numCoords,
-               int     numObjs,
-               int     numClusters,
-               float   threshold,
-               int    *membership,
-               float **clusters) {
-    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+/* Partial-distance search: the squared distance is accumulated in blocks of
+ * PDS_BLOCK coordinates (one SIMD register of floats) and a center is dropped
+ * as soon as the running sum exceeds the best distance so far. The terms are
+ * non-negative, so a dropped center could never have won. The previous
+ * cluster of the object is tried first, which usually makes the bound tight
+ * from the start; ties still go to the lowest index, as in the full kernel.
+ */
+#define PDS_BLOCK 8
+
+/* timestamp for the trace; no clock read when tracing is off */
+#define TRACE_NOW() ((trace != NULL) ? omp_get_wtime() : 0.0)
+
+__inline static int find_nearest_cluster_pds(int numClusters,
+                                             int numCoords,
+                                             float *object,
+                                             float **clusters,
+                                             int previous) {
+    int   index    = (previous >= 0) ? previous : 0;
+    float min_dist = euclid_dist_2(numCoords, object, clusters[index]);
+    int   first    = index;
+
+    for (int i = 0; i < numClusters; i++) {
+        if (i == first) continue;
+
+        float *center = clusters[i];
+        float  ans    = 0.0f;
+        int    j      = 0;
+
+        for (; j + PDS_BLOCK <= numCoords; j += PDS_BLOCK) {
+            for (int k = j; k < j + PDS_BLOCK; k++) {
+                float diff = object[k] - center[k];
+                ans += diff * diff;
+            }
+            if (ans > min_dist) break;
+        }
+        if (ans > min_dist) continue;
 
-    /* Global accumulators for the new cluster sums and sizes */
-    int *newClusterSize = (int*) calloc(numClusters, sizeof(int));
-    if (newClusterSize == NULL) return 0;
+        for (; j < numCoords; j++) {
+            float diff = object[j] - center[j];
+            ans += diff * diff;
+        }
 
-    /* newClusters is allocated as a contiguous block for better locality:
-     * newClusters points to an array of float*; newClusters[0] points to
-     * numClusters * numCoords floats, and newClusters[i] = newClusters[0] + i*numCoords.
-     */
-    float **newClusters = (float**) malloc(numClusters * sizeof(float*));
-    if (newClusters == NULL) {
-        free(newClusterSize);
-        return 0;
+        if (ans < min_dist || (ans == min_dist && i < index)) {
+            min_dist = ans;
+            index    = i;
+        }
     }
-    newClusters[0] = (float*) calloc((size_t)numClusters * numCoords, sizeof(float));
-    if (newClusters[0] == NULL) {
-        free(newClusters);
-        free(newClusterSize);
-        return 0;
+
+    return index;
+}
+
+/* next cache-line aligned part of the arena; only measured if base is NULL */
+static void* workspace_part(char *base, size_t *offset, size_t bytes) {
+    void *part = (base != NULL) ? base + *offset : NULL;
+
+    *offset += PAD_TO_LINE(bytes);
+    return part;
+}
+
+/* Lay out the buffers of omp_kmeans_run() for up to numObjs objects,
+ * numClusters clusters, numCoords coordinates and maxThreads threads with
+ * the given options in the cache-line aligned arena, or only measure them
+ * if arena is NULL. Returns the size of the arena in bytes.
+ *
+ * Per-thread accumulators come first, one block per thread:
+ * - numClusters ints of cluster sizes
+ * - numClusters * numCoords floats of partial sums (private mode)
+ * - numCoords floats of the open run's sum (segmented mode)
+ * each part padded to whole cache lines, so no two threads ever write the
+ * same line. The atomic mode needs no block; the reproducible mode only the
+ * sizes. The arena is not cleared here: each thread first touches its own
+ * block in omp_kmeans_run(), so its pages land on the thread's NUMA node.
+ *
+ * Global accumulators for the new cluster sums and sizes follow. In atomic
+ * mode they hold `shards` replicas back to back; replica s is updated only
+ * by threads tid with tid * shards / nthreads == s, i.e. by one socket under
+ * compact binding, and is cleared by the first of those threads.
+ *
+ * socketOf[tid] records where each thread runs; threads are grouped by
+ * socket (members[groupStart[g] .. groupStart[g+1]) ascending by tid) for
+ * the two-level reduction.
+ *
+ * Thread tid assigns objects rangeStart[tid] .. rangeStart[tid+1]-1:
+ * equal shares, or with KMEANS_SCHED_ADAPTIVE shares proportional to
+ * threadSpeed[tid], its smoothed objects per second in the last
+ * iterations. Either way the ranges are contiguous and ascending in tid
+ * order, which the reproducible mode relies on.
+ *
+ * Reproducible mode: objects are bucketed by cluster in index order
+ * (order[clusterStart[i] ..]) and every cluster is summed sequentially in
+ * double, so the result does not depend on how objects were split among
+ * threads. rowSum holds one numCoords double accumulator per thread.
+ *
+ * Reordering: two copies of the objects (and of their memberships, original
+ * ids and weights) to regroup them by cluster into, and per-thread counts
+ * for the counting sort.
+ */
+size_t omp_kmeans_workspace(kmeans_workspace *ws,
+                            void  *arena,
+                            int    numObjs,
+                            int    numClusters,
+                            int    numCoords,
+                            int    maxThreads,
+                            const kmeans_opts *opts) {
+    int    reduction = (opts != NULL) ? opts->reduction : KMEANS_REDUCE_PRIVATE;
+    int    shards    = (reduction == KMEANS_REDUCE_ATOMIC && opts->shards > 1) ? opts->shards : 1;
+    int    reorder   = (opts != NULL && opts->reorder > 0);
+    int    weighted  = (reorder && opts->weights != NULL);
+    int    segmented = (reorder && reduction == KMEANS_REDUCE_PRIVATE);
+    char  *base      = (char*) arena;
+    size_t offset    = 0;
+
+    size_t sizeBytes = (reduction != KMEANS_REDUCE_ATOMIC)
+                     ? PAD_TO_LINE((size_t)numClusters * sizeof(int)) : 0;
+    size_t sumBytes  = (reduction == KMEANS_REDUCE_PRIVATE)
+                     ? PAD_TO_LINE((size_t)numClusters * numCoords * sizeof(float)) : 0;
+    size_t runBytes  = segmented ? PAD_TO_LINE((size_t)numCoords * sizeof(float)) : 0;
+
+    ws->maxObjs      = numObjs;
+    ws->maxClusters  = numClusters;
+    ws->maxCoords    = numCoords;
+    ws->maxThreads   = maxThreads;
+    ws->reduction    = reduction;
+    ws->shards       = shards;
+    ws->reorder      = reorder;
+    ws->weighted     = weighted;
+    ws->sumOffset    = sizeBytes;
+    ws->runOffset    = sizeBytes + sumBytes;
+    ws->threadStride = sizeBytes + sumBytes + runBytes;
+    ws->threadBlocks = (char*) workspace_part(base, &offset, (size_t)maxThreads * ws->threadStride);
+
+    ws->newClusterSize = (int*)    workspace_part(base, &offset,
+                                                  (size_t)shards * numClusters * sizeof(int));
+    ws->newClusters    = (float**) workspace_part(base, &offset, numClusters * sizeof(float*));
+    float *sums        = (float*)  workspace_part(base, &offset,
+                                                  (size_t)shards * numClusters * numCoords * sizeof(float));
+    if (base != NULL) ws->newClusters[0] = sums;
+
+    ws->partialClusterSize = (int**)   workspace_part(base, &offset, maxThreads * sizeof(int*));
+    ws->partialClusters    = (float**) workspace_part(base, &offset, maxThreads * sizeof(float*));
+    ws->socketOf    = (int*)    workspace_part(base, &offset, maxThreads * sizeof(int));
+    ws->members     = (int*)    workspace_part(base, &offset, maxThreads * sizeof(int));
+    ws->groupStart  = (int*)    workspace_part(base, &offset, ((size_t)maxThreads + 1) * sizeof(int));
+    ws->rangeStart  = (int*)    workspace_part(base, &offset, ((size_t)maxThreads + 1) * sizeof(int));
+    ws->threadSpeed = (double*) workspace_part(base, &offset, maxThreads * sizeof(double));
+
+    ws->order = ws->clusterStart = NULL;
+    ws->rowSum = NULL;
+    if (reduction == KMEANS_REDUCE_REPRO) {
+        ws->order        = (int*)    workspace_part(base, &offset, (size_t)numObjs * sizeof(int));
+        ws->clusterStart = (int*)    workspace_part(base, &offset,
+                                                    ((size_t)numClusters + 1) * sizeof(int));
+        ws->rowSum       = (double*) workspace_part(base, &offset,
+                                                    (size_t)maxThreads * numCoords * sizeof(double));
     }
-    for (int i = 1; i < numClusters; i++)
-        newClusters[i] = newClusters[i - 1] + numCoords;
 
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < numObjs; i++)
-        membership[i] = -1;
+    ws->reorderCount = NULL;
+    for (int b = 0; b < 2; b++) {
+        ws->sortedObjs[b]   = NULL;
+        ws->sortedData[b]   = NULL;
+        ws->sortedMemb[b]   = ws->sortedPerm[b] = ws->sortedWeight[b] = NULL;
+        if (!reorder) continue;
+
+        ws->sortedObjs[b] = (float**) workspace_part(base, &offset, numObjs * sizeof(float*));
+        ws->sortedData[b] = (float*)  workspace_part(base, &offset,
+                                                     (size_t)numObjs * numCoords * sizeof(float));
+        ws->sortedMemb[b] = (int*)    workspace_part(base, &offset, (size_t)numObjs * sizeof(int));
+        ws->sortedPerm[b] = (int*)    workspace_part(base, &offset, (size_t)numObjs * sizeof(int));
+        if (weighted)
+            ws->sortedWeight[b] = (int*) workspace_part(base, &offset,
+                                                        (size_t)numObjs * sizeof(int));
+    }
+    if (reorder)
+        ws->reorderCount = (int*) workspace_part(base, &offset,
+                                                 (size_t)maxThreads * numClusters * sizeof(int));
 
-    int loop = 0, maxThreads = omp_get_max_threads(), nthreads   = maxThreads;
-    double delta;
+    return offset;
+}
 
-    /* Per-thread accumulators:
-     * - partialClusterSize: for each thread, numClusters ints
-     * - partialClusters: for each thread, numClusters * numCoords floats
-     *
-     * - Using maxThreads guarantees enough space even if fewer threads are used.
-     */
-    int   *partialClusterSize = (int*)   calloc((size_t)maxThreads * numClusters, sizeof(int));
-    float *partialClusters    = (float*) calloc((size_t)maxThreads * numClusters * numCoords,
-                                                sizeof(float));
-    if (partialClusterSize == NULL || partialClusters == NULL) {
-        free(partialClusterSize);
-        free(partialClusters);
+/* omp_kmeans() on a workspace laid out by omp_kmeans_workspace(); it never
+ * allocates. Returns 0 if the problem or the options need more than the
+ * workspace was laid out for.
+ */
+int omp_kmeans_run(float **objects,
+                   int     numCoords,
+                   int     numObjs,
+                   int     numClusters,
+                   float   threshold,
+                   int    *membership,
+                   float **clusters,
+                   const kmeans_opts *opts,
+                   kmeans_workspace  *ws) {
+    if (objects == NULL || membership == NULL || clusters == NULL || ws == NULL) return 0;
+
+    int reduction = (opts != NULL) ? opts->reduction : KMEANS_REDUCE_PRIVATE;
+    int shards    = (reduction == KMEANS_REDUCE_ATOMIC && opts->shards > 1) ? opts->shards : 1;
+    int kernel    = (opts != NULL) ? opts->kernel : KMEANS_KERNEL_FULL;
+    int reorder   = (opts != NULL && opts->reorder > 0) ? opts->reorder : 0;
+    int schedule  = (opts != NULL) ? opts->schedule : KMEANS_SCHED_STATIC;
+
+    /* weighted objects: object i counts weights[i] times (e.g. a coreset) */
+    const int *weights = (opts != NULL) ? opts->weights : NULL;
+    kmeans_trace *trace = (opts != NULL) ? opts->trace : NULL;
+
+    if (numObjs > ws->maxObjs || numClusters > ws->maxClusters || numCoords > ws->maxCoords ||
+        reduction != ws->reduction || shards > ws->shards ||
+        (reorder > 0 && !ws->reorder) || (reorder > 0 && weights != NULL && !ws->weighted))
         return 0;
+
+    double totalWeight = numObjs;
+    if (weights != NULL) {
+        totalWeight = 0.0;
+        for (int i = 0; i < numObjs; i++)
+            totalWeight += weights[i];
     }
 
-    /* Main k-means loop: assign points, accumulate partial sums, reduce, recompute centers */
-    do {
-        delta = 0.0;
+    /* with reordering, private-mode accumulation sums runs of same-cluster
+     * objects and flushes each run once (a segmented sum)
+     */
+    int segmented = (reorder > 0 && reduction == KMEANS_REDUCE_PRIVATE);
+
+    /* the workspace's buffers, see omp_kmeans_workspace() */
+    int     *newClusterSize     = ws->newClusterSize;
+    float  **newClusters        = ws->newClusters;
+    int    **partialClusterSize = ws->partialClusterSize;
+    float  **partialClusters    = ws->partialClusters;
+    int     *socketOf           = ws->socketOf;
+    int     *members            = ws->members;
+    int     *groupStart         = ws->groupStart;
+    int     *rangeStart         = ws->rangeStart;
+    double  *threadSpeed        = ws->threadSpeed;
+    int     *order              = ws->order;
+    int     *clusterStart       = ws->clusterStart;
+    double  *rowSum             = ws->rowSum;
+    int    **sortedMemb         = ws->sortedMemb, **sortedPerm = ws->sortedPerm;
+    int    **sortedWeight       = ws->sortedWeight;
+    float ***sortedObjs         = ws->sortedObjs;
+    int     *reorderCount       = ws->reorderCount;
+
+    /* the row pointers follow this run's numCoords */
+    for (int i = 1; i < numClusters; i++)
+        newClusters[i] = newClusters[i - 1] + numCoords;
+    if (reorder > 0)
+        for (int b = 0; b < 2; b++)
+            for (int i = 0; i < numObjs; i++)
+                sortedObjs[b][i] = ws->sortedData[b] + (size_t)i * numCoords;
+
+    int loop = 0, maxThreads = omp_get_max_threads(), nthreads, done = 0, numGroups = 0;
+    double delta = 0.0;
+
+    if (maxThreads > ws->maxThreads) maxThreads = ws->maxThreads;
+    nthreads = maxThreads;
+    topology_cpus(NULL);  /* discovered once, not by the threads at once */
+    memset(threadSpeed, 0, maxThreads * sizeof(double));
+
+    /* Reordering: every `reorder` iterations the objects are regrouped by
+     * cluster (a stable counting sort) into one of two copies, so that
+     * same-cluster objects are contiguous. viewObjs/viewMemb are the current
+     * view and viewPerm maps its rows back to the original object ids (NULL
+     * while the view is still objects itself); viewWeight follows along.
+     * reorderCount holds per-thread counts.
+     */
+    float     **viewObjs   = objects;
+    int        *viewMemb   = membership, *viewPerm = NULL;
+    const int  *viewWeight = weights;
+    int         next       = 0;
+
+    /* One parallel region for the whole run: every iteration is a sequence of
+     * barrier-separated phases (assign + accumulate, reduce + recompute,
+     * convergence check) executed by the same team, so there is no fork/join
+     * per phase and each buffer is cleared exactly once per iteration.
+     */
+    #pragma omp parallel num_threads(maxThreads) \
+            shared(nthreads, delta, done, loop, numGroups, \
+                   viewObjs, viewMemb, viewPerm, viewWeight, next)
+    {
+        int tid = omp_get_thread_num();
 
-        /* Parallel region: each thread uses its own local accumulator slices
-         * and contributes to a shared reduction variable delta.
-         */
-        #pragma omp parallel shared(nthreads, partialClusterSize, partialClusters) reduction(+:delta)
+        #pragma omp single
         {
-            int tid = omp_get_thread_num();
+            nthreads = omp_get_num_threads();
+            /* the split of schedule(static): the first numObjs % nthreads
+             * threads get one object more
+             */
+            for (int t = 0; t <= nthreads; t++)
+                rangeStart[t] = t * (numObjs / nthreads) +
+                                (t < numObjs % nthreads ? t : numObjs % nthreads);
+        }
 
-            #pragma omp single
-            {
-                nthreads = omp_get_num_threads();
+        /* this thread's local accumulators (private/reproducible modes) or its
+         * replica of the shared sums (atomic mode)
+         */
+        int   *localClusterSize = NULL;
+        float *localClusters    = NULL;
+        float *run              = NULL;  /* segmented mode: the open run's sum */
+        if (reduction == KMEANS_REDUCE_ATOMIC) {
+            int shard = tid * shards / nthreads;
+            localClusterSize = newClusterSize + (size_t)shard * numClusters;
+            localClusters    = newClusters[0] + (size_t)shard * numClusters * numCoords;
+
+            /* the first thread of a shard clears its replica; replicas no
+             * thread maps to (shards > nthreads) are cleared by thread 0
+             */
+            for (int sh = 0; sh < shards; sh++) {
+                int first = (int)(((long)sh * nthreads + shards - 1) / shards);
+                if (first >= nthreads || first * shards / nthreads != sh) first = 0;
+                if (first != tid) continue;
+                memset(newClusterSize + (size_t)sh * numClusters, 0, numClusters * sizeof(int));
+                memset(newClusters[0] + (size_t)sh * numClusters * numCoords, 0,
+                       (size_t)numClusters * numCoords * sizeof(float));
             }
+        } else {
+            char *block = ws->threadBlocks + (size_t)tid * ws->threadStride;
+
+            localClusterSize = (int*) block;
+            if (reduction == KMEANS_REDUCE_PRIVATE)
+                localClusters = (float*) (block + ws->sumOffset);
+            if (segmented)
+                run = (float*) (block + ws->runOffset);
+            partialClusterSize[tid] = localClusterSize;
+            partialClusters[tid]    = localClusters;
+        }
+        socketOf[tid] = topology_current_socket();
 
-            /* compute pointers to this thread's local accumulators */
-            int   *localClusterSize = partialClusterSize + tid * numClusters;
-            float *localClusters    = partialClusters + ((size_t)tid * numClusters * numCoords);
+        /* group threads by socket, keeping tid order inside each group */
+        #pragma omp barrier
+        #pragma omp single
+        {
+            int n = 0;
+            for (int t = 0; t < nthreads; t++) {
+                int seen = 0;
+                for (int u = 0; u < t && !seen; u++)
+                    seen = (socketOf[u] == socketOf[t]);
+                if (seen) continue;
+
+                groupStart[numGroups++] = n;
+                for (int u = t; u < nthreads; u++)
+                    if (socketOf[u] == socketOf[t]) members[n++] = u;
+            }
+            groupStart[numGroups] = n;
+        }
 
-            memset(localClusterSize, 0, numClusters * sizeof(int));
-            memset(localClusters, 0, (size_t)numClusters * numCoords * sizeof(float));
+        /* this thread's group and its rank within the group */
+        int group = 0, rank = 0;
+        for (int g = 0; g < numGroups; g++)
+            for (int m = groupStart[g]; m < groupStart[g + 1]; m++)
+                if (members[m] == tid) {
+                    group = g;
+                    rank  = m - groupStart[g];
+                }
 
-            /* distribute objects across threads; each thread updates its local accumulators */
-            #pragma omp for schedule(static)
-            for (int i = 0; i < numObjs; i++) {
-                int index = find_nearest_cluster(numClusters, numCoords, objects[i], clusters);
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++)
+            membership[i] = -1;
+
+        /* Main k-means loop: assign points, accumulate partial sums, reduce, recompute centers */
+        int iter = 0;  /* this thread's iteration count, for the trace */
+        while (!done) {
+            /* private copies of the view, so the loops keep them in registers */
+            float     **objs = viewObjs;
+            int        *memb = viewMemb, *perm = viewPerm;
+            const int  *wts  = viewWeight;
+            double      t0   = TRACE_NOW(), t1, t2, t3, t4;
+            double      a0   = (schedule == KMEANS_SCHED_ADAPTIVE) ? omp_get_wtime() : 0.0;
+            int         lo   = rangeStart[tid], hi = rangeStart[tid + 1];
+            double      changed = 0.0;
+
+            /* Phase 1: distribute objects across threads; each thread updates
+             * its local accumulators and the shared reduction variable delta.
+             * The loops do not wait, so the barrier below shows the imbalance.
+             */
+            if (reduction == KMEANS_REDUCE_ATOMIC) {
+                for (int i = lo; i < hi; i++) {
+                    int index = (kernel == KMEANS_KERNEL_PDS)
+                              ? find_nearest_cluster_pds(numClusters, numCoords, objs[i],
+                                                         clusters, memb[i])
+                              : find_nearest_cluster(numClusters, numCoords, objs[i], clusters);
+
+                    int w = (wts != NULL) ? wts[i] : 1;
+
+                    if (memb[i] != index) changed += w;
+                    memb[i] = index;
+
+                    #pragma omp atomic
+                    localClusterSize[index] += w;
+
+                    float *clusterAccum = localClusters + index * numCoords;
+                    for (int j = 0; j < numCoords; j++) {
+                        #pragma omp atomic
+                        clusterAccum[j] += w * objs[i][j];
+                    }
+                }
+            } else if (segmented) {
+                memset(localClusterSize, 0, numClusters * sizeof(int));
+                memset(localClusters, 0, (size_t)numClusters * numCoords * sizeof(float));
+
+                /* objects come grouped by their last cluster: sum the current
+                 * run of equal assignments in run[] and add it to the cluster's
+                 * row only when the run ends
+                 */
+                int runIndex = -1, runSize = 0;
+
+                for (int i = lo; i < hi; i++) {
+                    int index = (kernel == KMEANS_KERNEL_PDS)
+                              ? find_nearest_cluster_pds(numClusters, numCoords, objs[i],
+                                                         clusters, memb[i])
+                              : find_nearest_cluster(numClusters, numCoords, objs[i], clusters);
+
+                    int w = (wts != NULL) ? wts[i] : 1;
+
+                    if (memb[i] != index) changed += w;
+                    memb[i] = index;
+
+                    if (index != runIndex) {
+                        if (runSize > 0) {
+                            float *clusterAccum = localClusters + runIndex * numCoords;
+                            localClusterSize[runIndex] += runSize;
+                            for (int j = 0; j < numCoords; j++)
+                                clusterAccum[j] += run[j];
+                        }
+                        runIndex = index;
+                        runSize  = 0;
+                        for (int j = 0; j < numCoords; j++)
+                            run[j] = 0.0f;
+                    }
+                    runSize += w;
+                    for (int j = 0; j < numCoords; j++)
+                        run[j] += w * objs[i][j];
+                }
+                if (runSize > 0) {
+                    float *clusterAccum = localClusters + runIndex * numCoords;
+                    localClusterSize[runIndex] += runSize;
+                    for (int j = 0; j < numCoords; j++)
+                        clusterAccum[j] += run[j];
+                }
+            } else {
+                memset(localClusterSize, 0, numClusters * sizeof(int));
+                if (reduction == KMEANS_REDUCE_PRIVATE)
+                    memset(localClusters, 0, (size_t)numClusters * numCoords * sizeof(float));
+
+                for (int i = lo; i < hi; i++) {
+                    int index = (kernel == KMEANS_KERNEL_PDS)
+                              ? find_nearest_cluster_pds(numClusters, numCoords, objs[i],
+                                                         clusters, memb[i])
+                              : find_nearest_cluster(numClusters, numCoords, objs[i], clusters);
+
+                    int w = (wts != NULL) ? wts[i] : 1;
+
+                    /* count how many objects changed membership (for convergence check) */
+                    if (memb[i] != index) changed += w;
+                    memb[i] = index;
+
+                    /* update local accumulators for the assigned cluster
+                     * (the reproducible mode only counts objects here)
+                     */
+                    if (reduction == KMEANS_REDUCE_REPRO) {
+                        localClusterSize[index]++;
+                        continue;
+                    }
+                    localClusterSize[index] += w;
+
+                    float *clusterAccum = localClusters + index * numCoords;
+                    for (int j = 0; j < numCoords; j++)
+                        clusterAccum[j] += w * objs[i][j];
+                }
+            }
+            t1 = TRACE_NOW();
+            if (schedule == KMEANS_SCHED_ADAPTIVE) {
+                double speed = (hi - lo) / (omp_get_wtime() - a0 + 1e-9);
+                threadSpeed[tid] = (threadSpeed[tid] > 0.0)
+                                 ? 0.5 * threadSpeed[tid] + 0.5 * speed : speed;
+            }
+            #pragma omp atomic
+            delta += changed;
+            #pragma omp barrier
+            t2 = t3 = TRACE_NOW();
+
+            /* Phase 2: reduce the accumulators and recompute the centers,
+             * parallelized over clusters.
+             */
+            if (reduction == KMEANS_REDUCE_REPRO) {
+                /* turn the per-thread counts into write offsets: cluster
+                 * by cluster, thread slices follow in tid order, and since
+                 * the ranges are contiguous and ascending in tid order,
+                 * every bucket ends up sorted by object index
+                 */
+                #pragma omp single
+                {
+                    int offset = 0;
+                    for (int c = 0; c < numClusters; c++) {
+                        clusterStart[c] = offset;
+                        for (int t = 0; t < nthreads; t++) {
+                            int count = partialClusterSize[t][c];
+                            partialClusterSize[t][c] = offset;
+                            offset += count;
+                        }
+                    }
+                    clusterStart[numClusters] = offset;
+                }
 
-                /* count how many objects changed membership (for convergence check) */
-                if (membership[i] != index) delta += 1.0;
-                membership[i] = index;
+                /* same range as phase 1: each thread revisits exactly the
+                 * objects it assigned
+                 */
+                for (int i = lo; i < hi; i++)
+                    order[localClusterSize[memb[i]]++] = i;
+                #pragma omp barrier
+                t3 = TRACE_NOW();
+
+                /* sum each bucket in object order and recompute its center */
+                #pragma omp for schedule(dynamic, 16)
+                for (int i = 0; i < numClusters; i++) {
+                    double  count = clusterStart[i + 1] - clusterStart[i];
+                    double *sum   = rowSum + (size_t)tid * numCoords;
+
+                    if (count == 0) continue;
+
+                    for (int j = 0; j < numCoords; j++)
+                        sum[j] = 0.0;
+                    if (wts != NULL) count = 0.0;
+                    for (int k = clusterStart[i]; k < clusterStart[i + 1]; k++) {
+                        float *obj = objs[order[k]];
+                        double w   = (wts != NULL) ? wts[order[k]] : 1.0;
+
+                        if (wts != NULL) count += w;
+                        for (int j = 0; j < numCoords; j++)
+                            sum[j] += w * obj[j];
+                    }
+                    for (int j = 0; j < numCoords; j++)
+                        clusters[i][j] = (float)(sum[j] / count);
+                }
+            } else if (reduction == KMEANS_REDUCE_ATOMIC) {
+                /* fold replicas 1..shards-1 into replica 0, recompute, and
+                 * leave every replica cleared for the next iteration
+                 */
+                #pragma omp for schedule(static)
+                for (int i = 0; i < numClusters; i++) {
+                    float *dest = newClusters[i];
+
+                    for (int s = 1; s < shards; s++) {
+                        int   *srcSize = newClusterSize + (size_t)s * numClusters;
+                        float *src     = newClusters[0] + ((size_t)s * numClusters + i) * numCoords;
+
+                        newClusterSize[i] += srcSize[i];
+                        srcSize[i] = 0;
+                        for (int j = 0; j < numCoords; j++) {
+                            dest[j] += src[j];
+                            src[j] = 0.0f;
+                        }
+                    }
+
+                    if (newClusterSize[i] > 0) {
+                        float inv = 1.0f / newClusterSize[i];
+                        for (int j = 0; j < numCoords; j++)
+                            clusters[i][j] = dest[j] * inv;
+                    }
+                    for (int j = 0; j < numCoords; j++)
+                        dest[j] = 0.0f;
+                    newClusterSize[i] = 0;
+                }
+            } else {
+                /* Two-level tree reduction. Intra-socket: the members of a
+                 * group split its clusters among themselves and fold the other
+                 * members' slices into the group leader's, reading only memory
+                 * local to their socket.
+                 */
+                int  first  = groupStart[group], size = groupStart[group + 1] - first;
+                int  clo    = (int)((long)numClusters * rank / size);
+                int  chi    = (int)((long)numClusters * (rank + 1) / size);
+                int *leadSize = partialClusterSize[members[first]];
+
+                for (int i = clo; i < chi; i++) {
+                    float *dest = partialClusters[members[first]] + (size_t)i * numCoords;
+
+                    for (int m = first + 1; m < first + size; m++) {
+                        float *src = partialClusters[members[m]] + (size_t)i * numCoords;
+
+                        leadSize[i] += partialClusterSize[members[m]][i];
+                        for (int j = 0; j < numCoords; j++)
+                            dest[j] += src[j];
+                    }
+                }
+                #pragma omp barrier
+                t3 = TRACE_NOW();
+
+                /* Inter-socket: sum the group leaders' slices of one cluster
+                 * into newClusters[i] (overwritten, so it needs no clearing)
+                 * and rescale it
+                 */
+                #pragma omp for schedule(static)
+                for (int i = 0; i < numClusters; i++) {
+                    int   clusterCount = 0;
+                    float *dest        = newClusters[i];
+
+                    for (int j = 0; j < numCoords; j++)
+                        dest[j] = 0.0f;
+
+                    for (int g = 0; g < numGroups; g++) {
+                        int    lead = members[groupStart[g]];
+                        float *src  = partialClusters[lead] + (size_t)i * numCoords;
+
+                        clusterCount += partialClusterSize[lead][i];
+                        for (int j = 0; j < numCoords; j++)
+                            dest[j] += src[j];
+                    }
+
+                    if (clusterCount > 0) {
+                        float inv = 1.0f / clusterCount;
+                        for (int j = 0; j < numCoords; j++)
+                            clusters[i][j] = dest[j] * inv;
+                    }
+                }
+            }
 
-                /* update local accumulators for the assigned cluster */
-                localClusterSize[index]++;
+            t4 = TRACE_NOW();
 
-                float *clusterAccum = localClusters + index * numCoords;
-                for (int j = 0; j < numCoords; j++)
-                    clusterAccum[j] += objects[i][j];
+            /* Phase 3: convergence check on the fraction of objects that
+             * changed membership; the implicit barrier publishes done
+             */
+            #pragma omp single
+            {
+                double tc = TRACE_NOW();
+
+                delta /= totalWeight;
+                done   = !(delta > threshold && loop++ < 500);
+                if (trace != NULL)
+                    trace_record(trace, TRACE_CHECK, iter, tc, TRACE_NOW(), delta);
+                delta  = 0.0;
+
+                /* resize the ranges in proportion to the measured speeds.
+                 * Each speed is raised to at least a quarter of the mean, so
+                 * a thread whose range rounded to 0 objects (and so measured
+                 * 0) still gets work to time; with no speed measured at all
+                 * every thread gets the same floor, i.e. the even split.
+                 */
+                if (schedule == KMEANS_SCHED_ADAPTIVE && !done) {
+                    double total = 0.0, sum = 0.0, minSpeed;
+                    for (int t = 0; t < nthreads; t++)
+                        total += threadSpeed[t];
+                    minSpeed = (total > 0.0) ? 0.25 * total / nthreads : 1.0;
+                    total = 0.0;
+                    for (int t = 0; t < nthreads; t++) {
+                        if (!(threadSpeed[t] >= minSpeed)) threadSpeed[t] = minSpeed;
+                        total += threadSpeed[t];
+                    }
+                    for (int t = 0; t < nthreads; t++) {
+                        sum += threadSpeed[t];
+                        rangeStart[t + 1] = (t == nthreads - 1)
+                                          ? numObjs : (int)(numObjs * (sum / total));
+                    }
+                }
             }
-        }
 
-        memset(newClusterSize, 0, numClusters * sizeof(int));
-        memset(newClusters[0], 0, (size_t)numClusters * numCoords * sizeof(float));
-
-        /* Reduce per-thread accumulators into global accumulators.
-         * Parallelizing over clusters is natural: each iteration aggregates the
-         * contributions for one cluster across all threads.
-         */
-        #pragma omp parallel for schedule(static)
-        for (int i = 0; i < numClusters; i++) {
-            int   clusterCount = 0;
-            float *dest        = newClusters[i];
+            if (trace != NULL) {
+                trace_record(trace, TRACE_ASSIGN, iter, t0, t1, -1.0);
+                trace_record(trace, TRACE_WAIT,   iter, t1, t2, -1.0);
+                if (t3 > t2)
+                    trace_record(trace, TRACE_REDUCE, iter, t2, t3, -1.0);
+                trace_record(trace, TRACE_UPDATE, iter, t3, t4, -1.0);
+            }
 
-            for (int tid = 0; tid < nthreads; tid++) {
-                int   *localClusterSize = partialClusterSize + tid * numClusters;
-                float *localClusters    = partialClusters + ((size_t)tid * numClusters * numCoords);
+            /* Phase 4 (every `reorder` iterations): regroup the objects by
+             * cluster into the other copy, keeping object order within a
+             * cluster; same chunking as phase 1, as in the reproducible mode
+             */
+            if (reorder > 0 && !done && loop % reorder == 0) {
+                int   *count = reorderCount + (size_t)tid * numClusters;
+                double t5    = TRACE_NOW();
+
+                memset(count, 0, numClusters * sizeof(int));
+                #pragma omp for schedule(static)
+                for (int i = 0; i < numObjs; i++)
+                    count[memb[i]]++;
+
+                #pragma omp single
+                {
+                    int offset = 0;
+                    for (int c = 0; c < numClusters; c++)
+                        for (int t = 0; t < nthreads; t++) {
+                            int *tc = reorderCount + (size_t)t * numClusters;
+                            int  n  = tc[c];
+                            tc[c]   = offset;
+                            offset += n;
+                        }
+                }
 
-                clusterCount += localClusterSize[i];
+                float **dstObjs = sortedObjs[next];
+                int    *dstMemb = sortedMemb[next], *dstPerm = sortedPerm[next];
+                int    *dstWeight = sortedWeight[next];
+                #pragma omp for schedule(static)
+                for (int i = 0; i < numObjs; i++) {
+                    int k = count[memb[i]]++;
+
+                    memcpy(dstObjs[k], objs[i], numCoords * sizeof(float));
+                    dstMemb[k] = memb[i];
+                    dstPerm[k] = (perm != NULL) ? perm[i] : i;
+                    if (wts != NULL) dstWeight[k] = wts[i];
+                }
 
-                float *src = localClusters + i * numCoords;
-                for (int j = 0; j < numCoords; j++)
-                    dest[j] += src[j];
+                #pragma omp single
+                {
+                    viewObjs = dstObjs;
+                    viewMemb = dstMemb;
+                    viewPerm = dstPerm;
+                    if (wts != NULL) viewWeight = dstWeight;
+                    next = 1 - next;
+                }
+                if (trace != NULL)
+                    trace_record(trace, TRACE_REORDER, iter, t5, TRACE_NOW(), -1.0);
             }
+            iter++;
+        }
 
-            newClusterSize[i] = clusterCount;
+        /* return the memberships in the original object order */
+        if (viewPerm != NULL) {
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++)
+                membership[viewPerm[i]] = viewMemb[i];
         }
+    }
 
-        /* Recompute cluster centers from summed coordinates and sizes.
-         * Also clear newClusters entries for the next iteration (we reuse the buffer).
-         */
-        #pragma omp parallel for schedule(static)
-        for (int i = 0; i < numClusters; i++) {
-            if (newClusterSize[i] > 0) {
-                float inv = 1.0f / newClusterSize[i];
-                for (int j = 0; j < numCoords; j++) {
-                    clusters[i][j] = newClusters[i][j] * inv;
-                    newClusters[i][j] = 0.0f;
-                }
-            } else
-                for (int j = 0; j < numCoords; j++)
-                    newClusters[i][j] = 0.0f;
+    return loop + 1;
+}
 
-            newClusterSize[i] = 0;
-        }
+// return an array of cluster centers of size [numClusters][numCoords]
+int omp_kmeans(float **objects,
+               int     numCoords,
+               int     numObjs,
+               int     numClusters,
+               float   threshold,
+               int    *membership,
+               float **clusters,
+               const kmeans_opts *opts) {
+    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+
+    kmeans_workspace ws;
+    int              maxThreads = omp_get_max_threads(), loop;
+    size_t           bytes = omp_kmeans_workspace(&ws, NULL, numObjs, numClusters, numCoords,
+                                                  maxThreads, opts);
+    void            *arena = NULL;
 
-        /* fraction of objects that changed membership this iteration */
-        delta /= numObjs;
-    } while (delta > threshold && loop++ < 500); 
+    if (posix_memalign(&arena, CACHE_LINE, bytes) != 0) return 0;
+    omp_kmeans_workspace(&ws, arena, numObjs, numClusters, numCoords, maxThreads, opts);
 
-    free(newClusters[0]);
-    free(newClusters);
-    free(newClusterSize);
-    free(partialClusterSize);
-    free(partialClusters);
+    loop = omp_kmeans_run(objects, numCoords, numObjs, numClusters, threshold, membership,
+                          clusters, opts, &ws);
 
-    return 1;
+    free(arena);
+    return loop;
 }
@@ -11,15 +11,82 @@
 
 int _debug;
 
+/* how the initial centers are chosen when no -c file is given */
+#define SEED_FIRST           0
+#define SEED_KMEANSPP        1
+#define SEED_KMEANS_PARALLEL 2
+
+/* clustering engines selectable with -e */
+#define ENGINE_LLOYD   0
+#define ENGINE_BF16    1
+#define ENGINE_KDTREE  2
+#define ENGINE_YINYANG 3
+
+static const char *engine_names[] = { "lloyd", "bf16", "kdtree", "yinyang" };
+
+/* events kept by -T (the last ones win): 32 bytes each */
+#define TRACE_EVENTS (1L << 20)
+
+/* max. number of values in a -K list */
+#define MAX_K_LIST 64
+
+/* max. number of policies in a -P list */
+#define MAX_PIN_LIST 4
+
+/* -Y points per policy: 1, 2, 4, ... threads, then the maximum */
+#define MAX_SCALING_POINTS (MAX_PIN_LIST * 33)
+
+/* one point of the -Y scaling curves */
+typedef struct {
+    int    policy;
+    int    threads;
+    double seconds;
+} scaling_point;
+
 static void usage(char *argv0, float threshold) {
     char *help =
         "Usage: %s [switches] -i filename -n num_clusters\n"
         "       -i filename    : file containing data to be clustered\n"
         "       -c centers     : file containing initial centers (default: filename)\n"
         "       -b             : input file is in binary format (default: no)\n"
+        "       -x             : input file is sparse: \"id col:value ...\" lines, or\n"
+        "                        CSR with -b (lloyd only, no -s/-w/-K/-R/-T);\n"
+        "                        near-ties may resolve unlike the dense engines\n"
+        "       -s method      : initial centers: first, kmeans++ or kmeans||\n"
+        "                        (default: first; ignored with -c)\n"
+        "       -S seed        : random seed for -s kmeans++/kmeans|| (default: 1)\n"
         "       -n num_clusters: number of clusters (K must > 1)\n"
         "       -t threshold   : threshold value (default %.4f)\n"
         "       -p nproc       : number of OpenMP threads (default: runtime)\n"
+        "       -e engine      : lloyd (default), bf16 (assignment screened on a\n"
+        "                        bf16 copy of the data, near-ties re-checked in fp32)\n"
+        "                        kdtree (kd-tree filtering, for few coordinates)\n"
+        "                        or yinyang (group-filtered, for large K)\n"
+        "       -k kernel      : lloyd distance kernel: full (default) or pds\n"
+        "                        (partial-distance search, previous cluster first)\n"
+        "       -m period      : lloyd: regroup objects by cluster every period\n"
+        "                        iterations for locality (default: 0, never)\n"
+        "       -w             : lloyd: cluster the distinct points, weighted by\n"
+        "                        their multiplicity (for heavily duplicated data)\n"
+        "       -K k1,k2,...   : run these numbers of clusters concurrently in one\n"
+        "                        pass over the data (replaces -n)\n"
+        "       -R restarts    : with -K or -n, also run this many seeds per K\n"
+        "                        (seed, seed+1, ...; needs -s kmeans++/kmeans||\n"
+        "                        and no -c, which would repeat the same centers)\n"
+        "       -T tracefile   : lloyd: record per-iteration, per-phase, per-thread\n"
+        "                        timestamps; Chrome trace if it ends in .json, else CSV\n"
+        "       -P p1,p2,...   : pin threads: none (default), compact (fill a core's\n"
+        "                        SMT siblings first), scatter (alternate sockets)\n"
+        "                        or core (one thread per physical core first);\n"
+        "                        the run uses p1, -Y measures all of them\n"
+        "       -L             : lloyd: size the threads' object ranges by their\n"
+        "                        measured throughput (for hybrid P/E-core cpus)\n"
+        "       -Y             : lloyd, with -o: also time 1, 2, 4, ... threads\n"
+        "                        under each -P policy and report scaling curves\n"
+        "       -r             : lloyd: reproducible reduction, independent of -p\n"
+        "       -a             : lloyd: accumulate atomically into shared sums\n"
+        "       -A shards      : lloyd: like -a, with this many replicas of the sums\n"
+        "                        (e.g. one per socket, for large K)\n"
         "       -o             : output timing results (default: no)\n"
         "       -q             : quiet mode\n"
         "       -d             : enable debug mode\n"
@@ -28,19 +95,257 @@ static void usage(char *argv0, float threshold) {
     exit(-1);
 }
 
+/* -K/-R mode: seed every (K, restart) configuration, run them all with
+ * omp_multi_kmeans(), report iterations and inertia of each, and write out
+ * the restart of the first K with the lowest inertia. Returns 0 on success.
+ */
+static int run_multi(float **objects, int numObjs, int numCoords,
+                     const int *Ks, int numK, int restarts,
+                     int seedMethod, unsigned int seed, int isBinaryFile,
+                     char *filename, char *center_filename,
+                     float threshold, int verbose, int is_output_timing) {
+    int            numConfigs = numK * restarts, best = 0, ok = 1;
+    double         timing;
+    kmeans_config *configs    = (kmeans_config*) calloc(numConfigs, sizeof(kmeans_config));
+    assert(configs != NULL);
+
+    for (int c = 0; c < numConfigs && ok; c++) {
+        int K = Ks[c / restarts], r = c % restarts;
+
+        configs[c].numClusters = K;
+        configs[c].clusters    = (float**) malloc(K * sizeof(float*));
+        assert(configs[c].clusters != NULL);
+        configs[c].clusters[0] = (float*)  malloc((size_t)K * numCoords * sizeof(float));
+        assert(configs[c].clusters[0] != NULL);
+        for (int i = 1; i < K; i++)
+            configs[c].clusters[i] = configs[c].clusters[i - 1] + numCoords;
+        configs[c].membership  = (int*) malloc((size_t)numObjs * sizeof(int));
+        assert(configs[c].membership != NULL);
+
+        if (center_filename != filename)
+            ok = read_n_objects(isBinaryFile, center_filename, K, numCoords, configs[c].clusters);
+        else if (seedMethod == SEED_KMEANSPP)
+            ok = omp_kmeanspp_seed(objects, numCoords, numObjs, K, seed + r, configs[c].clusters);
+        else if (seedMethod == SEED_KMEANS_PARALLEL)
+            ok = omp_kmeans_parallel_seed(objects, numCoords, numObjs, K, seed + r,
+                                          configs[c].clusters);
+        else
+            for (int i = 0; i < K; i++)
+                for (int j = 0; j < numCoords; j++)
+                    configs[c].clusters[i][j] = objects[i][j];
+
+        if (ok && check_repeated_clusters(K, numCoords, configs[c].clusters) == 0) {
+            printf("Error: some initial clusters are repeated (K=%d, restart %d)\n", K, r);
+            ok = 0;
+        }
+    }
+
+    timing = wtime();
+    if (ok && !omp_multi_kmeans(objects, numCoords, numObjs, threshold, configs, numConfigs)) {
+        fprintf(stderr, "Error: omp_multi_kmeans failed\n");
+        ok = 0;
+    }
+    timing = wtime() - timing;
+
+    if (ok) {
+        printf("\n     K  restart       seed  iterations          inertia\n");
+        for (int c = 0; c < numConfigs; c++) {
+            printf("%6d %8d %10u %11d %16.6e\n", configs[c].numClusters, c % restarts,
+                   (seedMethod != SEED_FIRST && center_filename == filename) ? seed + c % restarts : 0,
+                   configs[c].iterations, configs[c].inertia);
+            if (c < restarts && configs[c].inertia < configs[best].inertia) best = c;
+        }
+
+        file_write(filename, configs[best].numClusters, numObjs, numCoords,
+                   configs[best].clusters, configs[best].membership, verbose);
+
+        if (is_output_timing) {
+            printf("\nPerforming **** Multi-configuration Kmeans (OpenMP version) ****\n");
+            printf("Input file:     %s\n", filename);
+            printf("numObjs       = %d\n", numObjs);
+            printf("numCoords     = %d\n", numCoords);
+            printf("Configurations= %d (%d K x %d restarts)\n", numConfigs, numK, restarts);
+            printf("threshold     = %.4f\n", threshold);
+            printf("Threads       = %d\n", omp_get_max_threads());
+            printf("Computation timing = %10.4f sec\n", timing);
+        }
+    }
+
+    for (int c = 0; c < numConfigs; c++) {
+        if (configs[c].clusters != NULL) free(configs[c].clusters[0]);
+        free(configs[c].clusters);
+        free(configs[c].membership);
+    }
+    free(configs);
+
+    return ok ? 0 : 1;
+}
+
+/* -x mode: cluster a sparse data set with omp_sparse_kmeans(). The initial
+ * centers are the first numClusters objects (or dense rows of -c), the
+ * results are written like the dense ones. Returns 0 on success.
+ */
+static int run_sparse(int isBinaryFile, char *filename, char *center_filename,
+                      int numClusters, float threshold, int verbose,
+                      int is_output_timing) {
+    double      io_timing = wtime(), timing;
+    kmeans_csr *data;
+    float     **clusters;
+    int        *membership;
+    int         ok = 1;
+
+    printf("reading sparse data points from file %s\n", filename);
+    data = sparse_read(isBinaryFile, filename);
+    if (data == NULL) return 1;
+
+    if (data->numObjs < numClusters) {
+        printf("Error: number of clusters must be larger than the number of data points to be clustered.\n");
+        sparse_free(data);
+        return 1;
+    }
+
+    clusters    = (float**) malloc(numClusters * sizeof(float*));
+    assert(clusters != NULL);
+    clusters[0] = (float*)  calloc((size_t)numClusters * data->numCoords, sizeof(float));
+    assert(clusters[0] != NULL);
+    for (int i = 1; i < numClusters; i++)
+        clusters[i] = clusters[i - 1] + data->numCoords;
+    membership  = (int*) malloc((size_t)data->numObjs * sizeof(int));
+    assert(membership != NULL);
+
+    if (center_filename != filename) {
+        printf("reading initial %d centers from file %s\n", numClusters, center_filename);
+        ok = read_n_objects(isBinaryFile, center_filename, numClusters, data->numCoords, clusters);
+    } else {
+        /* densify the first numClusters rows; a repeated row would leave a
+         * cluster empty, so compare the rows as stored
+         */
+        printf("selecting the first %d elements as initial centers\n", numClusters);
+        for (int i = 0; i < numClusters && ok; i++) {
+            long start = data->rowStart[i], nnz = data->rowStart[i + 1] - start;
+
+            for (long k = start; k < start + nnz; k++)
+                clusters[i][data->colIdx[k]] = data->values[k];
+            for (int p = 0; p < i; p++) {
+                long pstart = data->rowStart[p];
+                if (data->rowStart[p + 1] - pstart == nnz &&
+                    memcmp(data->colIdx + pstart, data->colIdx + start, nnz * sizeof(int)) == 0 &&
+                    memcmp(data->values + pstart, data->values + start, nnz * sizeof(float)) == 0) {
+                    printf("Error: some initial clusters are repeated. Please select distinct initial centers\n");
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    timing    = wtime();
+    io_timing = timing - io_timing;
+    if (ok) {
+        ok = omp_sparse_kmeans(data, numClusters, threshold, membership, clusters);
+        if (!ok) fprintf(stderr, "Error: omp_sparse_kmeans failed\n");
+    }
+    timing = wtime() - timing;
+
+    if (ok) {
+        double write_timing = wtime();
+
+        file_write(filename, numClusters, data->numObjs, data->numCoords, clusters,
+                   membership, verbose);
+        io_timing += wtime() - write_timing;
+
+        if (is_output_timing) {
+            printf("\nPerforming **** Sparse Kmeans (OpenMP version) ****\n");
+            printf("Input file:     %s\n", filename);
+            printf("numObjs       = %d\n", data->numObjs);
+            printf("numCoords     = %d\n", data->numCoords);
+            printf("nnz           = %ld (%.1f per object)\n", data->nnz,
+                   (double)data->nnz / data->numObjs);
+            printf("numClusters   = %d\n", numClusters);
+            printf("threshold     = %.4f\n", threshold);
+            printf("Threads       = %d\n", omp_get_max_threads());
+            printf("Iterations    = %d\n", ok);
+            printf("I/O time           = %10.4f sec\n", io_timing);
+            printf("Computation timing = %10.4f sec\n", timing);
+        }
+    }
+
+    sparse_free(data);
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+
+    return ok ? 0 : 1;
+}
+
+/* -Y mode: time omp_kmeans() from the same initial centers at 1, 2, 4, ...
+ * and maxThreads threads under each pinning policy. The team is left pinned
+ * to the last policy; the caller re-pins for its own run. Returns the number
+ * of points written to curve[].
+ */
+static int run_scaling(float **objects, int numObjs, int numCoords, int numClusters,
+                       float threshold, float **initClusters, const kmeans_opts *runOpts,
+                       const int *policies, int numPolicies, int maxThreads,
+                       scaling_point *curve) {
+    kmeans_opts opts = *runOpts;
+    int         numPoints = 0;
+    int        *membership = (int*) malloc((size_t)numObjs * sizeof(int));
+    float     **clusters   = (float**) malloc(numClusters * sizeof(float*));
+
+    assert(membership != NULL && clusters != NULL);
+    clusters[0] = (float*) malloc((size_t)numClusters * numCoords * sizeof(float));
+    assert(clusters[0] != NULL);
+    for (int c = 1; c < numClusters; c++)
+        clusters[c] = clusters[c - 1] + numCoords;
+
+    /* the sweep is not part of the trace */
+    opts.trace = NULL;
+
+    for (int p = 0; p < numPolicies; p++)
+        for (int t = 1; ; t = (2 * t < maxThreads) ? 2 * t : maxThreads) {
+            double timing;
+
+            memcpy(clusters[0], initClusters[0], (size_t)numClusters * numCoords * sizeof(float));
+            omp_set_num_threads(t);
+            topology_pin_threads(policies[p], t);
+
+            timing = wtime();
+            omp_kmeans(objects, numCoords, numObjs, numClusters, threshold, membership,
+                       clusters, &opts);
+            curve[numPoints].policy  = policies[p];
+            curve[numPoints].threads = t;
+            curve[numPoints].seconds = wtime() - timing;
+            numPoints++;
+
+            if (t == maxThreads) break;
+        }
+
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+
+    return numPoints;
+}
+
 int main(int argc, char **argv) {
            int     opt;
     extern char   *optarg;
     extern int     optind;
            int     i, j, numThreads, isBinaryFile, is_output_timing, verbose;
+           int     seedMethod, engine, ok, useCoreset, numDistinct, isSparse;
+           int     Ks[MAX_K_LIST], numK, restarts;
+           int     pinPolicies[MAX_PIN_LIST], numPin, doScaling, numScaling, maxThreads;
+           unsigned int seed;
+           scaling_point scalingCurve[MAX_SCALING_POINTS];
 
            int     numClusters, numCoords, numObjs;
-           int    *membership;
-           char   *filename, *center_filename;
+           int    *membership, *objectMap, *weights;
+           char   *filename, *center_filename, *trace_filename;
            float **objects;
            float **clusters;
            float   threshold;
-           double  timing, io_timing, clustering_timing;
+           kmeans_opts opts;
+           double  timing, io_timing, clustering_timing, seeding_timing, scaling_timing;
 
     _debug             = 0;
     verbose            = 1;
@@ -50,9 +355,30 @@ int main(int argc, char **argv) {
     is_output_timing   = 0;
     filename           = NULL;
     center_filename    = NULL;
+    trace_filename     = NULL;
     numThreads         = 0;
+    seedMethod         = SEED_FIRST;
+    engine             = ENGINE_LLOYD;
+    seed               = 1;
+    seeding_timing     = 0.0;
+    scaling_timing     = 0.0;
+    opts.reduction     = KMEANS_REDUCE_PRIVATE;
+    opts.shards        = 1;
+    opts.kernel        = KMEANS_KERNEL_FULL;
+    opts.reorder       = 0;
+    opts.weights       = NULL;
+    opts.trace         = NULL;
+    opts.schedule      = KMEANS_SCHED_STATIC;
+    useCoreset         = 0;
+    numK               = 0;
+    restarts           = 1;
+    numDistinct        = 0;
+    isSparse           = 0;
+    numPin             = 0;
+    doScaling          = 0;
+    numScaling         = 0;
 
-    while ((opt = getopt(argc, argv, "p:i:c:n:t:abdohq")) != EOF) {
+    while ((opt = getopt(argc, argv, "p:i:c:n:t:s:S:A:e:k:m:K:R:T:P:abdohqrwxLY")) != EOF) {
         switch (opt) {
             case 'p':
                 numThreads = atoi(optarg);
@@ -72,9 +398,81 @@ int main(int argc, char **argv) {
             case 'n':
                 numClusters = atoi(optarg);
                 break;
+            case 's':
+                if (strcmp(optarg, "first") == 0)
+                    seedMethod = SEED_FIRST;
+                else if (strcmp(optarg, "kmeans++") == 0 || strcmp(optarg, "kpp") == 0)
+                    seedMethod = SEED_KMEANSPP;
+                else if (strcmp(optarg, "kmeans||") == 0 || strcmp(optarg, "kpar") == 0)
+                    seedMethod = SEED_KMEANS_PARALLEL;
+                else
+                    usage(argv[0], threshold);
+                break;
+            case 'S':
+                seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                for (engine = ENGINE_YINYANG; engine > ENGINE_LLOYD; engine--)
+                    if (strcmp(optarg, engine_names[engine]) == 0) break;
+                if (strcmp(optarg, engine_names[engine]) != 0)
+                    usage(argv[0], threshold);
+                break;
             case 'o':
                 is_output_timing = 1;
                 break;
+            case 'k':
+                if (strcmp(optarg, "full") == 0)
+                    opts.kernel = KMEANS_KERNEL_FULL;
+                else if (strcmp(optarg, "pds") == 0)
+                    opts.kernel = KMEANS_KERNEL_PDS;
+                else
+                    usage(argv[0], threshold);
+                break;
+            case 'r':
+                opts.reduction = KMEANS_REDUCE_REPRO;
+                break;
+            case 'a':
+                opts.reduction = KMEANS_REDUCE_ATOMIC;
+                break;
+            case 'K':
+                for (char *tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                    if (numK == MAX_K_LIST || atoi(tok) <= 1) usage(argv[0], threshold);
+                    Ks[numK++] = atoi(tok);
+                }
+                break;
+            case 'R':
+                restarts = atoi(optarg);
+                if (restarts < 1) usage(argv[0], threshold);
+                break;
+            case 'T':
+                trace_filename = optarg;
+                break;
+            case 'w':
+                useCoreset = 1;
+                break;
+            case 'x':
+                isSparse = 1;
+                break;
+            case 'P':
+                for (char *tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                    if (numPin == MAX_PIN_LIST || topology_parse_policy(tok) < 0)
+                        usage(argv[0], threshold);
+                    pinPolicies[numPin++] = topology_parse_policy(tok);
+                }
+                break;
+            case 'L':
+                opts.schedule = KMEANS_SCHED_ADAPTIVE;
+                break;
+            case 'Y':
+                doScaling = 1;
+                break;
+            case 'm':
+                opts.reorder = atoi(optarg);
+                break;
+            case 'A':
+                opts.reduction = KMEANS_REDUCE_ATOMIC;
+                opts.shards    = atoi(optarg);
+                break;
             case 'q':
                 verbose = 0;
                 break;
@@ -90,11 +488,56 @@ int main(int argc, char **argv) {
     if (center_filename == NULL)
         center_filename = filename;
 
+    /* multi-configuration mode: numClusters becomes the largest K */
+    if (numK == 0 && restarts > 1 && numClusters > 1)
+        Ks[numK++] = numClusters;
+    for (i = 0; i < numK; i++)
+        if (Ks[i] > numClusters) numClusters = Ks[i];
+
     if (filename == NULL || numClusters <= 1) usage(argv[0], threshold);
+    /* restarts differ only in the seed of a random seeding */
+    if (restarts > 1 && (seedMethod == SEED_FIRST || center_filename != filename))
+        usage(argv[0], threshold);
+    if (numK > 0 && (engine != ENGINE_LLOYD || useCoreset || trace_filename != NULL))
+        usage(argv[0], threshold);
+    if ((useCoreset || trace_filename != NULL) && engine != ENGINE_LLOYD)
+        usage(argv[0], threshold);
+    if (isSparse && (engine != ENGINE_LLOYD || useCoreset || numK > 0 ||
+                     trace_filename != NULL || seedMethod != SEED_FIRST))
+        usage(argv[0], threshold);
+    /* -k, -m, -r, -a, -A and -L only tune omp_kmeans(); the other engines
+     * and the -K and -x modes would silently ignore them
+     */
+    if ((opts.kernel != KMEANS_KERNEL_FULL || opts.reorder != 0 ||
+         opts.reduction != KMEANS_REDUCE_PRIVATE || opts.schedule != KMEANS_SCHED_STATIC) &&
+        (engine != ENGINE_LLOYD || numK > 0 || isSparse))
+        usage(argv[0], threshold);
+    if (doScaling && (!is_output_timing || engine != ENGINE_LLOYD || useCoreset || numK > 0 ||
+                      isSparse))
+        usage(argv[0], threshold);
 
     if (numThreads > 0) {
         omp_set_num_threads(numThreads);
     }
+    maxThreads = omp_get_max_threads();
+
+    /* -Y with no -P compares against the unpinned team */
+    if (numPin == 0) pinPolicies[numPin++] = TOPOLOGY_PIN_NONE;
+    if (pinPolicies[0] != TOPOLOGY_PIN_NONE && !topology_pin_threads(pinPolicies[0], maxThreads))
+        fprintf(stderr, "Warning: could not pin threads (%s)\n",
+                topology_policy_name(pinPolicies[0]));
+
+    /* the trace buffer is allocated up front, so tracing costs no allocation
+     * (nor page faults) while clustering
+     */
+    if (trace_filename != NULL) {
+        opts.trace = trace_create(TRACE_EVENTS);
+        assert(opts.trace != NULL);
+    }
+
+    if (isSparse)
+        return run_sparse(isBinaryFile, filename, center_filename, numClusters, threshold,
+                          verbose, is_output_timing);
 
     if (is_output_timing) io_timing = wtime();
 
@@ -110,6 +553,15 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    if (numK > 0) {
+        ok = run_multi(objects, numObjs, numCoords, Ks, numK, restarts, seedMethod, seed,
+                       isBinaryFile, filename, center_filename, threshold, verbose,
+                       is_output_timing);
+        free(objects[0]);
+        free(objects);
+        return ok;
+    }
+
     clusters    = (float**) malloc(numClusters * sizeof(float*));
     assert(clusters != NULL);
     clusters[0] = (float*)  malloc((size_t)numClusters * numCoords * sizeof(float));
@@ -120,6 +572,26 @@ int main(int argc, char **argv) {
     if (center_filename != filename) {
         printf("reading initial %d centers from file %s\n", numClusters, center_filename);
         read_n_objects(isBinaryFile, center_filename, numClusters, numCoords, clusters);
+    } else if (seedMethod != SEED_FIRST) {
+        printf("seeding %d initial centers with %s (seed %u)\n", numClusters,
+               (seedMethod == SEED_KMEANSPP) ? "k-means++" : "k-means||", seed);
+
+        /* seeding is timed on its own and kept out of the I/O time */
+        seeding_timing = wtime();
+        if (seedMethod == SEED_KMEANSPP)
+            ok = omp_kmeanspp_seed(objects, numCoords, numObjs, numClusters, seed, clusters);
+        else
+            ok = omp_kmeans_parallel_seed(objects, numCoords, numObjs, numClusters, seed, clusters);
+        seeding_timing = wtime() - seeding_timing;
+
+        if (!ok) {
+            printf("Error: fewer than %d distinct data points to seed from.\n", numClusters);
+            free(objects[0]);
+            free(objects);
+            free(clusters[0]);
+            free(clusters);
+            return 1;
+        }
     } else {
         printf("selecting the first %d elements as initial centers\n", numClusters);
         for (i = 0; i < numClusters; i++)
@@ -146,17 +618,63 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* the scaling sweep runs from the same initial centers as the real run
+     * and is kept out of both the I/O and the computation time
+     */
+    if (doScaling) {
+        printf("timing 1 to %d threads under %d pinning polic%s\n", maxThreads, numPin,
+               (numPin > 1) ? "ies" : "y");
+        scaling_timing = wtime();
+        numScaling = run_scaling(objects, numObjs, numCoords, numClusters, threshold, clusters,
+                                 &opts, pinPolicies, numPin, maxThreads, scalingCurve);
+        scaling_timing = wtime() - scaling_timing;
+
+        omp_set_num_threads(maxThreads);
+        topology_pin_threads(pinPolicies[0], maxThreads);
+    }
+
     if (is_output_timing) {
         timing            = wtime();
-        io_timing         = timing - io_timing;
+        io_timing         = timing - io_timing - seeding_timing - scaling_timing;
         clustering_timing = timing;
     }
 
     membership = (int*) malloc((size_t)numObjs * sizeof(int));
     assert(membership != NULL);
 
-    if (!omp_kmeans(objects, numCoords, numObjs, numClusters, threshold,
-                    membership, clusters)) {
+    /* collapse duplicates; objects[] is replaced by the distinct points and
+     * the memberships are expanded again before writing them out
+     */
+    objectMap = NULL;
+    weights   = NULL;
+    if (useCoreset) {
+        float **distinct;
+
+        objectMap = (int*) malloc((size_t)numObjs * sizeof(int));
+        assert(objectMap != NULL);
+        distinct = coreset_collapse(objects, numCoords, numObjs, &numDistinct, &weights,
+                                    objectMap);
+        assert(distinct != NULL);
+
+        free(objects[0]);
+        free(objects);
+        objects      = distinct;
+        opts.weights = weights;
+    }
+
+    if (engine == ENGINE_BF16)
+        ok = omp_bf16_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                             membership, clusters);
+    else if (engine == ENGINE_KDTREE)
+        ok = omp_kdtree_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                               membership, clusters);
+    else if (engine == ENGINE_YINYANG)
+        ok = omp_yinyang_kmeans(objects, numCoords, numObjs, numClusters, threshold,
+                                membership, clusters);
+    else
+        ok = omp_kmeans(objects, numCoords, useCoreset ? numDistinct : numObjs, numClusters,
+                        threshold, membership, clusters, &opts);
+    if (!ok) {
         fprintf(stderr, "Error: omp_kmeans failed\n");
         free(objects[0]);
         free(objects);
@@ -169,6 +687,23 @@ int main(int argc, char **argv) {
     free(objects[0]);
     free(objects);
 
+    if (useCoreset) {
+        /* membership[] holds the distinct points' clusters: expand them to
+         * every original object through a copy
+         */
+        int *distinctMembership = (int*) malloc((size_t)numDistinct * sizeof(int));
+        assert(distinctMembership != NULL);
+        memcpy(distinctMembership, membership, (size_t)numDistinct * sizeof(int));
+
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < numObjs; i++)
+            membership[i] = distinctMembership[objectMap[i]];
+
+        free(distinctMembership);
+        free(objectMap);
+        free(weights);
+    }
+
     if (is_output_timing) {
         timing            = wtime();
         clustering_timing = timing - clustering_timing;
@@ -177,6 +712,11 @@ int main(int argc, char **argv) {
     file_write(filename, numClusters, numObjs, numCoords, clusters,
                membership, verbose);
 
+    if (opts.trace != NULL) {
+        trace_write(opts.trace, trace_filename);
+        trace_free(opts.trace);
+    }
+
     free(membership);
     free(clusters[0]);
     free(clusters);
@@ -190,9 +730,58 @@ int main(int argc, char **argv) {
         printf("numClusters   = %d\n", numClusters);
         printf("threshold     = %.4f\n", threshold);
         printf("Threads       = %d\n", (numThreads > 0) ? numThreads : omp_get_max_threads());
+        printf("Engine        = %s\n", engine_names[engine]);
+        printf("Iterations    = %d\n", ok);
+        {
+            int numCpus, cores, sockets, efficiency;
+
+            numCpus = topology_summary(&cores, &sockets, &efficiency);
+            printf("Topology      = %d cpus, %d cores, %d socket%s", numCpus, cores, sockets,
+                   (sockets > 1) ? "s" : "");
+            if (efficiency > 0)
+                printf(", %d efficiency cpus", efficiency);
+            printf("\n");
+            printf("Pinning       = %s\n", topology_policy_name(pinPolicies[0]));
+        }
+        if (engine == ENGINE_LLOYD) {
+            printf("Schedule      = %s\n",
+                   (opts.schedule == KMEANS_SCHED_ADAPTIVE) ? "adaptive" : "static");
+            printf("Kernel        = %s\n", (opts.kernel == KMEANS_KERNEL_PDS) ? "pds" : "full");
+            if (useCoreset)
+                printf("Coreset       = %d distinct points\n", numDistinct);
+            if (opts.reorder > 0)
+                printf("Reorder       = every %d iterations\n", opts.reorder);
+            if (opts.reduction == KMEANS_REDUCE_ATOMIC)
+                printf("Reduction     = atomic (%d shard%s)\n", (opts.shards > 1) ? opts.shards : 1,
+                       (opts.shards > 1) ? "s" : "");
+            else
+                printf("Reduction     = %s\n",
+                       (opts.reduction == KMEANS_REDUCE_REPRO) ? "reproducible" : "private");
+        }
 
         printf("I/O time           = %10.4f sec\n", io_timing);
+        if (seedMethod != SEED_FIRST && center_filename == filename)
+            printf("Seeding timing     = %10.4f sec\n", seeding_timing);
         printf("Computation timing = %10.4f sec\n", clustering_timing);
+
+        if (numScaling > 0) {
+            printf("\nScaling (%s schedule):\n",
+                   (opts.schedule == KMEANS_SCHED_ADAPTIVE) ? "adaptive" : "static");
+            printf("  %-8s %7s %10s %8s %10s\n", "policy", "threads", "seconds", "speedup",
+                   "efficiency");
+            for (i = 0; i < numScaling; i++) {
+                /* speedup over the same policy's single thread, which
+                 * is the first point of its curve
+                 */
+                double base    = scalingCurve[i - (i % (numScaling / numPin))].seconds;
+                double speedup = base / scalingCurve[i].seconds;
+
+                printf("  %-8s %7d %10.4f %8.2f %9.1f%%\n",
+                       topology_policy_name(scalingCurve[i].policy), scalingCurve[i].threads,
+                       scalingCurve[i].seconds, speedup,
+                       100.0 * speedup / scalingCurve[i].threads);
+            }
+        }
     }
 
     return 0;
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* objects per block: small enough to stay in L2 while every active
+ * configuration sweeps over it
+ */
+#define MULTI_BLOCK 1024
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+/* Run several k-means configurations (different K and/or initial centers)
+ * side by side over one pass of the data per iteration: objects are visited
+ * in blocks of MULTI_BLOCK, and each block is assigned by every active
+ * configuration while it is cache-hot. A configuration that meets its
+ * stopping test (the same as omp_kmeans()) is retired and no longer costs
+ * anything. configs[c].clusters holds the initial centers on entry and the
+ * final ones on return; membership, iterations and inertia (the sum of
+ * squared distances of the last assignment) are filled in.
+ */
+int omp_multi_kmeans(float        **objects,
+                     int            numCoords,
+                     int            numObjs,
+                     float          threshold,
+                     kmeans_config *configs,
+                     int            numConfigs) {
+    if (objects == NULL || configs == NULL || numConfigs <= 0) return 0;
+
+    int     maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    int     numBlocks  = (numObjs + MULTI_BLOCK - 1) / MULTI_BLOCK;
+    int     numActive  = numConfigs, allocFailed = 0;
+
+    /* accumulator layout shared by all threads: config c's sums start at
+     * sumOffset[c] doubles and its sizes at sizeOffset[c] longs
+     */
+    size_t *sumOffset  = (size_t*) malloc(((size_t)numConfigs + 1) * sizeof(size_t));
+    size_t *sizeOffset = (size_t*) malloc(((size_t)numConfigs + 1) * sizeof(size_t));
+    int    *active     = (int*)    malloc(numConfigs * sizeof(int));
+    int    *loop       = (int*)    calloc(numConfigs, sizeof(int));
+    long   *changed    = (long*)   calloc(numConfigs, sizeof(long));
+    double *inertia    = (double*) calloc(numConfigs, sizeof(double));
+    void  **threadAcc  = (void**)  calloc(maxThreads, sizeof(void*));
+    if (sumOffset == NULL || sizeOffset == NULL || active == NULL || loop == NULL ||
+        changed == NULL || inertia == NULL || threadAcc == NULL) {
+        free(sumOffset);
+        free(sizeOffset);
+        free(active);
+        free(loop);
+        free(changed);
+        free(inertia);
+        free(threadAcc);
+        return 0;
+    }
+
+    sumOffset[0] = sizeOffset[0] = 0;
+    for (int c = 0; c < numConfigs; c++) {
+        sumOffset[c + 1]  = sumOffset[c]  + (size_t)configs[c].numClusters * numCoords;
+        sizeOffset[c + 1] = sizeOffset[c] + configs[c].numClusters;
+        active[c] = c;
+        configs[c].iterations = 0;
+        configs[c].inertia    = 0.0;
+    }
+    size_t sumBytes  = PAD_TO_LINE(sumOffset[numConfigs] * sizeof(double));
+    size_t sizeBytes = PAD_TO_LINE(sizeOffset[numConfigs] * sizeof(long));
+
+    #pragma omp parallel shared(nthreads, numActive, allocFailed)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        /* per-thread sums and sizes of all configurations, owner-allocated */
+        void *block = NULL;
+        if (posix_memalign(&block, CACHE_LINE, sumBytes + sizeBytes) != 0) {
+            #pragma omp atomic write
+            allocFailed = 1;
+            block = NULL;
+        }
+        threadAcc[tid] = block;
+
+        double *localSum  = (double*) block;
+        long   *localSize = (long*) ((char*) block + sumBytes);
+
+        for (int c = 0; c < numConfigs; c++) {
+            #pragma omp for schedule(static) nowait
+            for (int i = 0; i < numObjs; i++)
+                configs[c].membership[i] = -1;
+        }
+
+        /* every thread has tried its allocation before anyone looks */
+        #pragma omp barrier
+        #pragma omp single
+        {
+            if (allocFailed) numActive = 0;
+        }
+
+        while (numActive > 0) {
+            for (int a = 0; a < numActive; a++) {
+                int c = active[a];
+                memset(localSum + sumOffset[c], 0,
+                       (sumOffset[c + 1] - sumOffset[c]) * sizeof(double));
+                memset(localSize + sizeOffset[c], 0,
+                       (sizeOffset[c + 1] - sizeOffset[c]) * sizeof(long));
+            }
+
+            /* Phase 1: one sweep over the data, every active configuration
+             * assigns a block before moving on to the next one
+             */
+            #pragma omp for schedule(static) \
+                    reduction(+:changed[:numConfigs]) reduction(+:inertia[:numConfigs])
+            for (int b = 0; b < numBlocks; b++) {
+                int start = b * MULTI_BLOCK;
+                int end   = (start + MULTI_BLOCK < numObjs) ? start + MULTI_BLOCK : numObjs;
+
+                for (int a = 0; a < numActive; a++) {
+                    int     c           = active[a];
+                    int     numClusters = configs[c].numClusters;
+                    float **clusters    = configs[c].clusters;
+                    int    *membership  = configs[c].membership;
+                    double *sum         = localSum + sumOffset[c];
+                    long   *size        = localSize + sizeOffset[c];
+
+                    for (int i = start; i < end; i++) {
+                        int   index    = 0;
+                        float min_dist = euclid_dist_2(numCoords, objects[i], clusters[0]);
+
+                        for (int k = 1; k < numClusters; k++) {
+                            float dist = euclid_dist_2(numCoords, objects[i], clusters[k]);
+                            if (dist < min_dist) {
+                                min_dist = dist;
+                                index    = k;
+                            }
+                        }
+
+                        if (membership[i] != index) changed[c]++;
+                        membership[i] = index;
+                        inertia[c]   += min_dist;
+
+                        size[index]++;
+                        for (int j = 0; j < numCoords; j++)
+                            sum[(size_t)index * numCoords + j] += objects[i][j];
+                    }
+                }
+            }
+
+            /* Phase 2: reduce and recompute, one (configuration, cluster)
+             * pair per iteration
+             */
+            long totalClusters = (long)sizeOffset[numConfigs];
+            #pragma omp for schedule(dynamic, 16)
+            for (long f = 0; f < totalClusters; f++) {
+                int c = 0;
+                while (sizeOffset[c + 1] <= (size_t)f) c++;
+                if (configs[c].iterations < 0) continue;  /* retired */
+
+                int  i     = (int)(f - (long)sizeOffset[c]);
+                long count = 0;
+                for (int t = 0; t < nthreads; t++)
+                    count += ((long*) ((char*) threadAcc[t] + sumBytes))[sizeOffset[c] + i];
+                if (count == 0) continue;
+
+                for (int j = 0; j < numCoords; j++) {
+                    double s = 0.0;
+                    for (int t = 0; t < nthreads; t++)
+                        s += ((double*) threadAcc[t])[sumOffset[c] + (size_t)i * numCoords + j];
+                    configs[c].clusters[i][j] = (float)(s / count);
+                }
+            }
+
+            /* Phase 3: per-configuration convergence check; converged
+             * configurations are retired from the active list
+             */
+            #pragma omp single
+            {
+                int n = 0;
+                for (int a = 0; a < numActive; a++) {
+                    int    c     = active[a];
+                    double delta = (double)changed[c] / numObjs;
+
+                    configs[c].inertia = inertia[c];
+                    if (!(delta > threshold && loop[c]++ < 500))
+                        configs[c].iterations = -(loop[c] + 1);  /* retired */
+                    else
+                        active[n++] = c;
+                    changed[c] = 0;
+                    inertia[c] = 0.0;
+                }
+                numActive = n;
+            }
+        }
+
+        free(block);
+    }
+
+    /* retired configurations were marked with a negative count */
+    for (int c = 0; c < numConfigs; c++)
+        configs[c].iterations = -configs[c].iterations;
+
+    free(sumOffset);
+    free(sizeOffset);
+    free(active);
+    free(loop);
+    free(changed);
+    free(inertia);
+    free(threadAcc);
+
+    return !allocFailed;
+}
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* Number of objects per cost block. Block sums are accumulated sequentially
+ * and combined in block order, so the sampled centers depend only on the
+ * seed and never on the number of threads.
+ */
+#define SEED_BLOCK 4096
+
+/* k-means|| parameters (Bahmani et al.): oversampling factor l = 2K and a
+ * fixed number of sampling rounds, which is enough in practice.
+ */
+#define KPAR_ROUNDS     5
+#define KPAR_OVERSAMPLE 2
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+/* counter-based generator: a uniform double in [0,1) for (seed, stream, i) */
+__inline static double rand_unit(uint64_t seed, uint64_t stream, uint64_t i) {
+    uint64_t z = seed * 0x9E3779B97F4A7C15ULL ^ (stream << 40) ^ i;
+
+    z += 0x9E3779B97F4A7C15ULL;
+    z  = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z  = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Tighten minDist[] (and nearest[], if given) with the objects listed in
+ * cand[first..last), then refresh the per-block cost sums. Returns the total
+ * cost, i.e. the sum of minDist[] over all objects.
+ */
+static double update_min_dist(float  **objects,
+                              int      numCoords,
+                              int      numObjs,
+                              const int *cand,
+                              int      first,
+                              int      last,
+                              float   *minDist,
+                              int     *nearest,
+                              double  *blockCost) {
+    int numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int b = 0; b < numBlocks; b++) {
+        int    end = (b + 1) * SEED_BLOCK < numObjs ? (b + 1) * SEED_BLOCK : numObjs;
+        double sum = 0.0;
+
+        for (int i = b * SEED_BLOCK; i < end; i++) {
+            for (int c = first; c < last; c++) {
+                float dist = euclid_dist_2(numCoords, objects[i], objects[cand[c]]);
+                if (dist < minDist[i]) {
+                    minDist[i] = dist;
+                    if (nearest != NULL) nearest[i] = c;
+                }
+            }
+            sum += minDist[i];
+        }
+        blockCost[b] = sum;
+    }
+
+    double total = 0.0;
+    for (int b = 0; b < numBlocks; b++)
+        total += blockCost[b];
+
+    return total;
+}
+
+/* Draw an object index with probability minDist[i] / total */
+static int sample_d2(int numObjs, const float *minDist, const double *blockCost,
+                     double total, double u) {
+    int    numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+    double target    = u * total;
+    int    b         = 0;
+
+    while (b < numBlocks - 1 && target >= blockCost[b]) {
+        target -= blockCost[b];
+        b++;
+    }
+
+    int end  = (b + 1) * SEED_BLOCK < numObjs ? (b + 1) * SEED_BLOCK : numObjs;
+    int last = -1;
+    for (int i = b * SEED_BLOCK; i < end; i++) {
+        if (minDist[i] <= 0.0f) continue;
+        last = i;
+        if (target < minDist[i]) return i;
+        target -= minDist[i];
+    }
+
+    /* rounding pushed target past the block: take its last positive entry */
+    return last;
+}
+
+/* Sequential weighted k-means++ over a small candidate set: pick numClusters
+ * of the numCand points in cand[], each weighted by weight[].
+ */
+static int weighted_kmeanspp(float  **objects,
+                             int      numCoords,
+                             const int *cand,
+                             const double *weight,
+                             int      numCand,
+                             int      numClusters,
+                             uint64_t seed,
+                             int     *chosen) {
+    double *minDist = (double*) malloc(numCand * sizeof(double));
+    if (minDist == NULL) return 0;
+
+    /* first pick is proportional to weight alone */
+    double total = 0.0;
+    for (int c = 0; c < numCand; c++)
+        total += weight[c];
+
+    double target = rand_unit(seed, 1, 0) * total;
+    int    pick   = numCand - 1;
+    for (int c = 0; c < numCand; c++) {
+        if (target < weight[c]) { pick = c; break; }
+        target -= weight[c];
+    }
+    chosen[0] = pick;
+
+    for (int c = 0; c < numCand; c++)
+        minDist[c] = euclid_dist_2(numCoords, objects[cand[c]], objects[cand[pick]]);
+
+    for (int k = 1; k < numClusters; k++) {
+        total = 0.0;
+        for (int c = 0; c < numCand; c++)
+            total += weight[c] * minDist[c];
+        if (total <= 0.0) {
+            free(minDist);
+            return 0;  /* fewer distinct candidates than clusters */
+        }
+
+        target = rand_unit(seed, 1, k) * total;
+        pick   = -1;
+        for (int c = 0; c < numCand; c++) {
+            double w = weight[c] * minDist[c];
+            if (w <= 0.0) continue;
+            pick = c;
+            if (target < w) break;
+            target -= w;
+        }
+        chosen[k] = pick;
+
+        for (int c = 0; c < numCand; c++) {
+            double dist = euclid_dist_2(numCoords, objects[cand[c]], objects[cand[pick]]);
+            if (dist < minDist[c]) minDist[c] = dist;
+        }
+    }
+
+    free(minDist);
+    return 1;
+}
+
+/* k-means++ seeding (Arthur & Vassilvitskii): each new center is an object
+ * drawn with probability proportional to its squared distance to the nearest
+ * center chosen so far. Duplicated objects have zero distance once one copy
+ * is a center, so the result never contains repeated centers.
+ * Returns 0 if the data set has fewer than numClusters distinct objects.
+ */
+int omp_kmeanspp_seed(float      **objects,
+                      int          numCoords,
+                      int          numObjs,
+                      int          numClusters,
+                      unsigned int seed,
+                      float      **clusters) {
+    int numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+    int ret       = 0;
+
+    float  *minDist   = (float*)  malloc((size_t)numObjs * sizeof(float));
+    double *blockCost = (double*) malloc(numBlocks * sizeof(double));
+    int    *chosen    = (int*)    malloc(numClusters * sizeof(int));
+    if (minDist == NULL || blockCost == NULL || chosen == NULL) goto out;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numObjs; i++)
+        minDist[i] = 3.402823466e+38f;
+
+    chosen[0] = (int)(rand_unit(seed, 0, 0) * numObjs);
+
+    for (int k = 1; k < numClusters; k++) {
+        double total = update_min_dist(objects, numCoords, numObjs, chosen, k - 1, k,
+                                       minDist, NULL, blockCost);
+        if (total <= 0.0) goto out;
+
+        chosen[k] = sample_d2(numObjs, minDist, blockCost, total, rand_unit(seed, 0, k));
+        if (chosen[k] < 0) goto out;
+    }
+
+    for (int k = 0; k < numClusters; k++)
+        memcpy(clusters[k], objects[chosen[k]], numCoords * sizeof(float));
+    ret = 1;
+
+out:
+    free(minDist);
+    free(blockCost);
+    free(chosen);
+    return ret;
+}
+
+/* Scalable k-means|| seeding (Bahmani et al.): starting from one random
+ * center, every round samples each object independently with probability
+ * l * d^2(x) / cost, so about l = 2K candidates are added per round in a
+ * single parallel pass. The candidates are then weighted by the number of
+ * objects closest to them and reduced to numClusters centers with weighted
+ * k-means++. Returns 0 if the data set has fewer than numClusters distinct
+ * objects.
+ */
+int omp_kmeans_parallel_seed(float      **objects,
+                             int          numCoords,
+                             int          numObjs,
+                             int          numClusters,
+                             unsigned int seed,
+                             float      **clusters) {
+    int    numBlocks = (numObjs + SEED_BLOCK - 1) / SEED_BLOCK;
+    int    capacity  = numClusters * KPAR_OVERSAMPLE * (KPAR_ROUNDS + 1) + 1;
+    int    numCand   = 0, ret = 0;
+    double oversample = (double)numClusters * KPAR_OVERSAMPLE;
+
+    float  *minDist    = (float*)  malloc((size_t)numObjs * sizeof(float));
+    int    *nearest    = (int*)    malloc((size_t)numObjs * sizeof(int));
+    double *blockCost  = (double*) malloc(numBlocks * sizeof(double));
+    int    *blockCount = (int*)    malloc(numBlocks * sizeof(int));
+    int    *cand       = (int*)    malloc(capacity * sizeof(int));
+    double *weight     = NULL;
+    int    *chosen     = (int*)    malloc(numClusters * sizeof(int));
+    if (minDist == NULL || nearest == NULL || blockCost == NULL ||
+        blockCount == NULL || cand == NULL || chosen == NULL) goto out;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numObjs; i++) {
+        minDist[i] = 3.402823466e+38f;
+        nearest[i] = 0;
+    }
+
+    cand[numCand++] = (int)(rand_unit(seed, 0, 0) * numObjs);
+    double cost = update_min_dist(objects, numCoords, numObjs, cand, 0, 1,
+                                  minDist, nearest, blockCost);
+
+    for (int round = 1; cost > 0.0 && (round <= KPAR_ROUNDS || numCand < numClusters); round++) {
+        int first = numCand;
+
+        /* count the samples of each block, then write them out in block
+         * order so the candidate list does not depend on the thread count
+         */
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < numBlocks; b++) {
+            int end = (b + 1) * SEED_BLOCK < numObjs ? (b + 1) * SEED_BLOCK : numObjs, n = 0;
+            for (int i = b * SEED_BLOCK; i < end; i++)
+                if (rand_unit(seed, round, i) * cost < oversample * minDist[i]) n++;
+            blockCount[b] = n;
+        }
+
+        int total = numCand;
+        for (int b = 0; b < numBlocks; b++) {
+            int n = blockCount[b];
+            blockCount[b] = total;
+            total += n;
+        }
+        if (total > capacity) {
+            capacity = total + numClusters * KPAR_OVERSAMPLE;
+            int *tmp = (int*) realloc(cand, capacity * sizeof(int));
+            if (tmp == NULL) goto out;
+            cand = tmp;
+        }
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < numBlocks; b++) {
+            int end = (b + 1) * SEED_BLOCK < numObjs ? (b + 1) * SEED_BLOCK : numObjs;
+            int pos = blockCount[b];
+            for (int i = b * SEED_BLOCK; i < end; i++)
+                if (rand_unit(seed, round, i) * cost < oversample * minDist[i])
+                    cand[pos++] = i;
+        }
+        numCand = total;
+
+        cost = update_min_dist(objects, numCoords, numObjs, cand, first, numCand,
+                               minDist, nearest, blockCost);
+    }
+    if (numCand < numClusters) goto out;
+
+    /* weight each candidate by the number of objects it is closest to */
+    weight = (double*) calloc(numCand, sizeof(double));
+    if (weight == NULL) goto out;
+    for (int i = 0; i < numObjs; i++)
+        weight[nearest[i]] += 1.0;
+
+    /* identical objects sampled in the same round can leave fewer distinct
+     * candidates than clusters: fall back to plain k-means++ in that case
+     */
+    if (!weighted_kmeanspp(objects, numCoords, cand, weight, numCand, numClusters,
+                           seed, chosen)) {
+        ret = omp_kmeanspp_seed(objects, numCoords, numObjs, numClusters, seed, clusters);
+        goto out;
+    }
+
+    for (int k = 0; k < numClusters; k++)
+        memcpy(clusters[k], objects[cand[chosen[k]]], numCoords * sizeof(float));
+    ret = 1;
+
+out:
+    free(minDist);
+    free(nearest);
+    free(blockCost);
+    free(blockCount);
+    free(cand);
+    free(weight);
+    free(chosen);
+    return ret;
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* Nearest center of one CSR row. |x - c|^2 = |x|^2 - 2 x.c + |c|^2, and |x|^2
+ * is the same for every center, so the row is scored on |c|^2 - 2 x.c. The
+ * dot products with all centers are accumulated at once from the transposed
+ * centers, one contiguous numClusters-wide row per non-zero. The score
+ * cancels differently from euclid_dist_2(), so an object (nearly) equidistant
+ * from two centers can be assigned unlike in the dense engines, and the run
+ * can then converge to a different partition.
+ */
+__inline static int find_nearest_cluster_sparse(int          numClusters,
+                                                const int   *colIdx,
+                                                const float *values,
+                                                long         nnz,
+                                                const float *centerT,
+                                                const float *centerNorm,
+                                                float       *dot) {
+    int   index;
+    float min_score;
+
+    for (int c = 0; c < numClusters; c++)
+        dot[c] = 0.0f;
+    for (long k = 0; k < nnz; k++) {
+        const float *row = centerT + (size_t)colIdx[k] * numClusters;
+        float        v   = values[k];
+        for (int c = 0; c < numClusters; c++)
+            dot[c] += v * row[c];
+    }
+
+    index     = 0;
+    min_score = centerNorm[0] - 2.0f * dot[0];
+    for (int c = 1; c < numClusters; c++) {
+        float score = centerNorm[c] - 2.0f * dot[c];
+        if (score < min_score) {
+            min_score = score;
+            index     = c;
+        }
+    }
+
+    return index;
+}
+
+/*----< omp_sparse_kmeans() >-------------------------------------------------*/
+/* Lloyd's algorithm on CSR input; clusters[] is dense
+ * [numClusters][numCoords] and holds the initial centers on entry. The
+ * objects are bucketed by cluster in index order, as in the reproducible
+ * mode of omp_kmeans(), and each cluster's center is rebuilt by scattering
+ * its objects' non-zeros into one dense double row per thread. No per-thread
+ * numClusters x numCoords partial sums are needed, which would not fit for
+ * wide data.
+ */
+int omp_sparse_kmeans(const kmeans_csr *data,
+                      int               numClusters,
+                      float             threshold,
+                      int              *membership,
+                      float           **clusters) {
+    if (data == NULL || membership == NULL || clusters == NULL) return 0;
+
+    int     numObjs = data->numObjs, numCoords = data->numCoords;
+    int     maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    int     loop = 0, done = 0, allocFailed = 0;
+    double  delta = 0.0;
+
+    float  *centerT      = (float*) malloc((size_t)numCoords * numClusters * sizeof(float));
+    float  *centerNorm   = (float*) malloc((size_t)numClusters * sizeof(float));
+    int    *order        = (int*)   malloc((size_t)numObjs * sizeof(int));
+    int    *clusterStart = (int*)   malloc(((size_t)numClusters + 1) * sizeof(int));
+    int   **threadCount  = (int**)  calloc(maxThreads, sizeof(int*));
+    if (centerT == NULL || centerNorm == NULL || order == NULL || clusterStart == NULL ||
+        threadCount == NULL) {
+        free(centerT);
+        free(centerNorm);
+        free(order);
+        free(clusterStart);
+        free(threadCount);
+        return 0;
+    }
+
+    #pragma omp parallel shared(nthreads, delta, done, loop, allocFailed)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        /* per-thread cluster counts, dot products and dense sum row,
+         * allocated by the owner
+         */
+        size_t countBytes = PAD_TO_LINE((size_t)numClusters * sizeof(int));
+        size_t dotBytes   = PAD_TO_LINE((size_t)numClusters * sizeof(float));
+        size_t rowBytes   = PAD_TO_LINE((size_t)numCoords * sizeof(double));
+        void  *block      = NULL;
+        if (posix_memalign(&block, CACHE_LINE, countBytes + dotBytes + rowBytes) != 0) {
+            #pragma omp atomic write
+            allocFailed = 1;
+            block = NULL;
+        }
+        int    *count  = (int*) block;
+        float  *dot    = (float*) ((char*) block + countBytes);
+        double *rowSum = (double*) ((char*) block + countBytes + dotBytes);
+        threadCount[tid] = count;
+        if (block != NULL)
+            memset(rowSum, 0, (size_t)numCoords * sizeof(double));
+
+        #pragma omp for schedule(static) nowait
+        for (int i = 0; i < numObjs; i++)
+            membership[i] = -1;
+
+        #pragma omp for schedule(static)
+        for (int c = 0; c < numClusters; c++) {
+            double norm = 0.0;
+            for (int j = 0; j < numCoords; j++)
+                norm += (double)clusters[c][j] * clusters[c][j];
+            centerNorm[c] = (float)norm;
+        }
+
+        #pragma omp single
+        {
+            if (allocFailed) done = 1;
+        }
+
+        while (!done) {
+            /* transpose the centers for the assignment */
+            #pragma omp for schedule(static)
+            for (int j = 0; j < numCoords; j++)
+                for (int c = 0; c < numClusters; c++)
+                    centerT[(size_t)j * numClusters + c] = clusters[c][j];
+
+            memset(count, 0, numClusters * sizeof(int));
+
+            #pragma omp for schedule(static) reduction(+:delta)
+            for (int i = 0; i < numObjs; i++) {
+                long start = data->rowStart[i];
+                int  index = find_nearest_cluster_sparse(numClusters, data->colIdx + start,
+                                                         data->values + start,
+                                                         data->rowStart[i + 1] - start,
+                                                         centerT, centerNorm, dot);
+
+                if (membership[i] != index) delta += 1.0;
+                membership[i] = index;
+                count[index]++;
+            }
+
+            /* per-thread counts become write offsets; every bucket ends up
+             * in object order
+             */
+            #pragma omp single
+            {
+                int offset = 0;
+                for (int c = 0; c < numClusters; c++) {
+                    clusterStart[c] = offset;
+                    for (int t = 0; t < nthreads; t++) {
+                        int n = threadCount[t][c];
+                        threadCount[t][c] = offset;
+                        offset += n;
+                    }
+                }
+                clusterStart[numClusters] = offset;
+            }
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++)
+                order[count[membership[i]]++] = i;
+
+            /* scatter each bucket's non-zeros into the dense row, rebuild
+             * the center and its norm, and leave the row cleared
+             */
+            #pragma omp for schedule(dynamic, 4)
+            for (int c = 0; c < numClusters; c++) {
+                double size = clusterStart[c + 1] - clusterStart[c];
+                double norm = 0.0;
+
+                if (size == 0) continue;
+
+                for (int k = clusterStart[c]; k < clusterStart[c + 1]; k++) {
+                    int i = order[k];
+                    for (long n = data->rowStart[i]; n < data->rowStart[i + 1]; n++)
+                        rowSum[data->colIdx[n]] += data->values[n];
+                }
+                for (int j = 0; j < numCoords; j++) {
+                    float center = (float)(rowSum[j] / size);
+
+                    clusters[c][j] = center;
+                    norm     += (double)center * center;
+                    rowSum[j] = 0.0;
+                }
+                centerNorm[c] = (float)norm;
+            }
+
+            #pragma omp single
+            {
+                delta /= numObjs;
+                done   = !(delta > threshold && loop++ < 500);
+                delta  = 0.0;
+            }
+        }
+
+        free(block);
+    }
+
+    free(centerT);
+    free(centerNorm);
+    free(order);
+    free(clusterStart);
+    free(threadCount);
+
+    return allocFailed ? 0 : loop + 1;
+}
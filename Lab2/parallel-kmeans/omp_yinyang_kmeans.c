@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define YY_GROUP_SIZE 10     /* centers per group: numGroups = numClusters / 10 */
+#define YY_CHUNK      256    /* objects per dynamic chunk of the assignment */
+
+/* relative slack of the pruning tests, so a center is only dropped when the
+ * fp32 kernel of plain Lloyd would not pick it either
+ */
+#define YY_SLACK 1e-5f
+
+/* nudge a bound loosened by a drift so fp32 rounding keeps it a bound */
+#define YY_EPS        1e-6f
+#define YY_UP(x)      ((x) + fabsf(x) * YY_EPS)
+#define YY_DOWN(x)    ((x) - fabsf(x) * YY_EPS)
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+/* Yinyang k-means (Ding et al., ICML 2015): the centers are split into
+ * groups once, and every object keeps an upper bound on the distance to its
+ * center and one lower bound per group on the distance to the group's other
+ * centers. Bounds are loosened by the center drifts every iteration; a group
+ * is only scanned when its bound falls below the upper bound.
+ */
+typedef struct {
+    float  **objects;
+    float  **clusters;
+    int      numCoords;
+    int      numClusters;
+    int      numGroups;
+    int     *groupStart;          /* [numGroups + 1] into groupMember */
+    int     *groupMember;         /* center ids, ascending within a group */
+    int     *groupOf;             /* [numClusters] */
+    float   *drift;               /* [numClusters] last center movement */
+    float   *groupDrift;          /* [numGroups] max drift in the group */
+    float   *upper;               /* [numObjs] */
+    float   *lower;               /* [numObjs][numGroups] */
+} yy_state;
+
+/* per-thread scratch of yy_assign(), one entry per group */
+typedef struct {
+    float *oldLower;
+    float *min1, *min2;
+    int   *min1Idx;
+    int   *scanned;
+} yy_scratch;
+
+/* Find the center of object i, currently in cluster a (-1 before the first
+ * pass, which scans everything and sets up the bounds). Centers are compared
+ * on the same fp32 squared distance as find_nearest_cluster(), ties going to
+ * the lower index, so the result is the one of plain Lloyd.
+ */
+static int yy_assign(yy_state *s, yy_scratch *w, int i, int a) {
+    float *obj   = s->objects[i];
+    float *lower = s->lower + (size_t)i * s->numGroups;
+    int    best  = -1;
+    float  bestD2 = FLT_MAX, bestDist = FLT_MAX, aD2 = FLT_MAX, aDist = FLT_MAX;
+
+    if (a >= 0) {
+        float globalLower = FLT_MAX;
+        float ub          = YY_UP(s->upper[i] + s->drift[a]);
+
+        for (int g = 0; g < s->numGroups; g++) {
+            w->oldLower[g] = lower[g];
+            lower[g]       = YY_DOWN(lower[g] - s->groupDrift[g]);
+            if (lower[g] < globalLower) globalLower = lower[g];
+        }
+
+        /* global filter, first on the loosened then on the exact bound */
+        if (ub * (1.0f + YY_SLACK) < globalLower) {
+            s->upper[i] = ub;
+            return a;
+        }
+        best     = a;
+        bestD2   = aD2   = euclid_dist_2(s->numCoords, obj, s->clusters[a]);
+        bestDist = aDist = sqrtf(aD2);
+        if (bestDist * (1.0f + YY_SLACK) < globalLower) {
+            s->upper[i] = bestDist;
+            return a;
+        }
+    }
+
+    /* group filter, then a local filter on the group's old bound */
+    for (int g = 0; g < s->numGroups; g++) {
+        w->scanned[g] = 0;
+        if (a >= 0 && bestDist * (1.0f + YY_SLACK) < lower[g]) continue;
+
+        float min1 = FLT_MAX, min2 = FLT_MAX;
+        int   min1Idx = -1;
+
+        for (int k = s->groupStart[g]; k < s->groupStart[g + 1]; k++) {
+            int   c = s->groupMember[k];
+            float d2, dist;
+
+            if (c == a) {
+                d2   = aD2;
+                dist = aDist;
+            } else {
+                if (a >= 0) {
+                    float bound = YY_DOWN(w->oldLower[g] - s->drift[c]);
+                    if (bound > bestDist * (1.0f + YY_SLACK)) {
+                        if (bound < min1)      { min2 = min1; min1 = bound; min1Idx = -1; }
+                        else if (bound < min2) min2 = bound;
+                        continue;
+                    }
+                }
+                d2   = euclid_dist_2(s->numCoords, obj, s->clusters[c]);
+                dist = sqrtf(d2);
+            }
+
+            if (d2 < bestD2 || (d2 == bestD2 && c < best)) {
+                best     = c;
+                bestD2   = d2;
+                bestDist = dist;
+            }
+            if (dist < min1)      { min2 = min1; min1 = dist; min1Idx = c; }
+            else if (dist < min2) min2 = dist;
+        }
+
+        w->scanned[g] = 1;
+        w->min1[g]    = min1;
+        w->min2[g]    = min2;
+        w->min1Idx[g] = min1Idx;
+    }
+
+    /* a scanned group's bound excludes the new center; the old center
+     * becomes an ordinary member of its group if that was not scanned
+     */
+    for (int g = 0; g < s->numGroups; g++)
+        if (w->scanned[g])
+            lower[g] = (w->min1Idx[g] == best) ? w->min2[g] : w->min1[g];
+    if (a >= 0 && best != a && !w->scanned[s->groupOf[a]] && aDist < lower[s->groupOf[a]])
+        lower[s->groupOf[a]] = aDist;
+
+    s->upper[i] = bestDist;
+    return best;
+}
+
+/* Split the centers into numGroups groups with a small k-means over the
+ * centers themselves, seeded with evenly spaced centers.
+ */
+static int yy_group(yy_state *s, float threshold) {
+    int     numGroups = s->numGroups, numCoords = s->numCoords;
+    float **groupCenters = (float**) malloc(numGroups * sizeof(float*));
+    int    *count        = (int*)    calloc(numGroups + 1, sizeof(int));
+
+    if (groupCenters == NULL || count == NULL) {
+        free(groupCenters);
+        free(count);
+        return 0;
+    }
+    groupCenters[0] = (float*) malloc((size_t)numGroups * numCoords * sizeof(float));
+    if (groupCenters[0] == NULL) {
+        free(groupCenters);
+        free(count);
+        return 0;
+    }
+    for (int g = 1; g < numGroups; g++)
+        groupCenters[g] = groupCenters[g - 1] + numCoords;
+    for (int g = 0; g < numGroups; g++)
+        memcpy(groupCenters[g], s->clusters[(long)g * s->numClusters / numGroups],
+               numCoords * sizeof(float));
+
+    int ok = (numGroups == 1)
+           ? 1 : seq_kmeans(s->clusters, numCoords, s->numClusters, numGroups, threshold,
+                            s->groupOf, groupCenters);
+    if (numGroups == 1)
+        memset(s->groupOf, 0, s->numClusters * sizeof(int));
+
+    /* bucket the centers by group, ascending ids within a group */
+    for (int c = 0; c < s->numClusters; c++)
+        count[s->groupOf[c] + 1]++;
+    for (int g = 0; g < numGroups; g++)
+        count[g + 1] += count[g];
+    memcpy(s->groupStart, count, (numGroups + 1) * sizeof(int));
+    for (int c = 0; c < s->numClusters; c++)
+        s->groupMember[count[s->groupOf[c]]++] = c;
+
+    free(groupCenters[0]);
+    free(groupCenters);
+    free(count);
+    return ok;
+}
+
+/*----< omp_yinyang_kmeans() >------------------------------------------------*/
+/* Memberships and centers are those of omp_kmeans() in the reproducible
+ * reduction mode (-r): the filtering only skips distance computations, and
+ * the centers are recomputed the same way, bucketing the objects by cluster
+ * and summing every bucket in object order in double.
+ */
+int omp_yinyang_kmeans(float **objects,
+                       int     numCoords,
+                       int     numObjs,
+                       int     numClusters,
+                       float   threshold,
+                       int    *membership,
+                       float **clusters) {
+    if (objects == NULL || membership == NULL || clusters == NULL) return 0;
+
+    int      maxThreads = omp_get_max_threads(), nthreads = maxThreads;
+    int      numGroups  = numClusters / YY_GROUP_SIZE;
+    int      loop = 0, done = 0, allocFailed = 0;
+    long     changed = 0;
+    yy_state s;
+
+    if (numGroups < 1) numGroups = 1;
+
+    s.objects     = objects;
+    s.clusters    = clusters;
+    s.numCoords   = numCoords;
+    s.numClusters = numClusters;
+    s.numGroups   = numGroups;
+    s.groupStart  = (int*)   malloc(((size_t)numGroups + 1) * sizeof(int));
+    s.groupMember = (int*)   malloc((size_t)numClusters * sizeof(int));
+    s.groupOf     = (int*)   malloc((size_t)numClusters * sizeof(int));
+    s.drift       = (float*) malloc((size_t)numClusters * sizeof(float));
+    s.groupDrift  = (float*) malloc((size_t)numGroups * sizeof(float));
+    s.upper       = (float*) malloc((size_t)numObjs * sizeof(float));
+    s.lower       = (float*) malloc((size_t)numObjs * numGroups * sizeof(float));
+    int    *order        = (int*)    malloc((size_t)numObjs * sizeof(int));
+    int    *clusterStart = (int*)    malloc(((size_t)numClusters + 1) * sizeof(int));
+    int   **threadCount  = (int**)   calloc(maxThreads, sizeof(int*));
+    if (s.groupStart == NULL || s.groupMember == NULL || s.groupOf == NULL ||
+        s.drift == NULL || s.groupDrift == NULL || s.upper == NULL || s.lower == NULL ||
+        order == NULL || clusterStart == NULL || threadCount == NULL ||
+        !yy_group(&s, threshold)) {
+        free(s.groupStart);
+        free(s.groupMember);
+        free(s.groupOf);
+        free(s.drift);
+        free(s.groupDrift);
+        free(s.upper);
+        free(s.lower);
+        free(order);
+        free(clusterStart);
+        free(threadCount);
+        return 0;
+    }
+
+    #pragma omp parallel shared(nthreads, done, loop, changed, allocFailed)
+    {
+        int tid = omp_get_thread_num();
+
+        #pragma omp single
+        {
+            nthreads = omp_get_num_threads();
+        }
+
+        /* per-thread cluster counts, sum row and group scratch, allocated
+         * by the owner
+         */
+        size_t countBytes   = PAD_TO_LINE((size_t)numClusters * sizeof(int));
+        size_t rowBytes     = PAD_TO_LINE((size_t)numCoords * sizeof(double));
+        size_t scratchBytes = PAD_TO_LINE((size_t)numGroups * 5 * sizeof(float));
+        void  *block        = NULL;
+        if (posix_memalign(&block, CACHE_LINE, countBytes + rowBytes + scratchBytes) != 0) {
+            #pragma omp atomic write
+            allocFailed = 1;
+            block = NULL;
+        }
+        int        *count  = (int*) block;
+        double     *rowSum = (double*) ((char*) block + countBytes);
+        float      *area   = (float*) ((char*) block + countBytes + rowBytes);
+        yy_scratch  w;
+        threadCount[tid] = count;
+        w.oldLower = area;
+        w.min1     = area + numGroups;
+        w.min2     = area + 2 * numGroups;
+        w.min1Idx  = (int*) (area + 3 * numGroups);
+        w.scanned  = (int*) (area + 4 * numGroups);
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < numObjs; i++)
+            membership[i] = -1;
+
+        #pragma omp single
+        {
+            if (allocFailed) done = 1;
+        }
+
+        while (!done) {
+            /* assignment; filtering makes the cost per object uneven */
+            #pragma omp for schedule(dynamic, YY_CHUNK) reduction(+:changed)
+            for (int i = 0; i < numObjs; i++) {
+                int index = yy_assign(&s, &w, i, membership[i]);
+
+                if (membership[i] != index) changed++;
+                membership[i] = index;
+            }
+
+            /* bucket the objects by cluster in index order, as the
+             * reproducible mode of omp_kmeans() does
+             */
+            memset(count, 0, numClusters * sizeof(int));
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++)
+                count[membership[i]]++;
+
+            #pragma omp single
+            {
+                int offset = 0;
+                for (int c = 0; c < numClusters; c++) {
+                    clusterStart[c] = offset;
+                    for (int t = 0; t < nthreads; t++) {
+                        int n = threadCount[t][c];
+                        threadCount[t][c] = offset;
+                        offset += n;
+                    }
+                }
+                clusterStart[numClusters] = offset;
+            }
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < numObjs; i++)
+                order[count[membership[i]]++] = i;
+
+            /* recompute the centers and record how far each one moved */
+            #pragma omp for schedule(dynamic, 16)
+            for (int c = 0; c < numClusters; c++) {
+                double size = clusterStart[c + 1] - clusterStart[c];
+                double move = 0.0;
+
+                s.drift[c] = 0.0f;
+                if (size == 0) continue;
+
+                for (int j = 0; j < numCoords; j++)
+                    rowSum[j] = 0.0;
+                for (int k = clusterStart[c]; k < clusterStart[c + 1]; k++) {
+                    float *obj = objects[order[k]];
+                    for (int j = 0; j < numCoords; j++)
+                        rowSum[j] += obj[j];
+                }
+                for (int j = 0; j < numCoords; j++) {
+                    float  center = (float)(rowSum[j] / size);
+                    double diff   = (double)center - clusters[c][j];
+
+                    move += diff * diff;
+                    clusters[c][j] = center;
+                }
+                s.drift[c] = YY_UP((float)sqrt(move));
+            }
+
+            /* group drifts and convergence check */
+            #pragma omp single
+            {
+                for (int g = 0; g < numGroups; g++) {
+                    float maxDrift = 0.0f;
+                    for (int k = s.groupStart[g]; k < s.groupStart[g + 1]; k++)
+                        if (s.drift[s.groupMember[k]] > maxDrift)
+                            maxDrift = s.drift[s.groupMember[k]];
+                    s.groupDrift[g] = maxDrift;
+                }
+
+                double delta = (double)changed / numObjs;
+                changed = 0;
+                done = !(delta > threshold && loop++ < 500);
+            }
+        }
+
+        free(block);
+    }
+
+    if (_debug)
+        printf("yinyang: %d groups, %d iterations\n", numGroups, loop + 1);
+
+    free(s.groupStart);
+    free(s.groupMember);
+    free(s.groupOf);
+    free(s.drift);
+    free(s.groupDrift);
+    free(s.upper);
+    free(s.lower);
+    free(order);
+    free(clusterStart);
+    free(threadCount);
+
+    return allocFailed ? 0 : loop + 1;
+}
@@ -1,7 +1,9 @@
 #!/usr/bin/env python3
 import os
 import re
+import csv
 import math
+import argparse
 import matplotlib.pyplot as plt
 
 # === Configuration ===
@@ -47,6 +49,36 @@ def parse_omp_logs_raw(log_dir):
             data[t] = times
     return dict(sorted(data.items(), key=lambda kv: kv[0]))
 
+def parse_bench_csv(path, engine):
+    """
+    Reads the CSV written by kmeans_bench. Only the first data set
+    (numObjs, numCoords, numClusters) in the file is used.
+    Returns:
+      seq_time: mean seconds per iteration of the "seq" engine
+      data: dict[int -> list[float]] seconds per iteration of `engine`
+            per thread count, in the same shape as parse_omp_logs_raw()
+    Per-iteration times are used because engines may need a different
+    number of iterations to converge.
+    """
+    with open(path, newline="") as f:
+        rows = list(csv.DictReader(f))
+    if not rows:
+        raise ValueError(f"No benchmark records in {path}")
+
+    key = lambda r: (r["numObjs"], r["numCoords"], r["numClusters"])
+    first = key(rows[0])
+    rows = [r for r in rows if key(r) == first]
+
+    seq = [float(r["sec_per_iter"]) for r in rows if r["engine"] == "seq"]
+    if not seq:
+        raise ValueError("No seq engine records found (run kmeans_bench with -e seq,...).")
+
+    data = {}
+    for r in rows:
+        if r["engine"] == engine:
+            data.setdefault(int(r["threads"]), []).append(float(r["sec_per_iter"]))
+    return sum(seq) / len(seq), dict(sorted(data.items()))
+
 def summarize_from_raw(seq_time, data):
     """
     From per-run times, compute avg/std per thread and derive speedup/efficiency.
@@ -143,15 +175,27 @@ def plot_boxplots(seq_time, data):
     if SHOW_PLOTS: plt.show()
 
 def main():
-    if not os.path.exists(LOG_DIR):
-        print(f"Error: Log directory '{LOG_DIR}' not found.")
-        return
-
-    seq_time = parse_seq_time(LOG_DIR)
-    data = parse_omp_logs_raw(LOG_DIR)
-    if not data:
-        print("No OpenMP run logs found in", LOG_DIR)
-        return
+    parser = argparse.ArgumentParser(description="Plot k-means OpenMP scaling results.")
+    parser.add_argument("--csv", help="kmeans_bench CSV output instead of the test_omp.sh logs")
+    parser.add_argument("--engine", default="lloyd",
+                        help="engine to plot from the CSV (default: lloyd)")
+    args = parser.parse_args()
+
+    if args.csv:
+        seq_time, data = parse_bench_csv(args.csv, args.engine)
+        if not data:
+            print(f"No records of engine '{args.engine}' in", args.csv)
+            return
+    else:
+        if not os.path.exists(LOG_DIR):
+            print(f"Error: Log directory '{LOG_DIR}' not found.")
+            return
+
+        seq_time = parse_seq_time(LOG_DIR)
+        data = parse_omp_logs_raw(LOG_DIR)
+        if not data:
+            print("No OpenMP run logs found in", LOG_DIR)
+            return
 
     summary = summarize_from_raw(seq_time, data)
     plot_speedup_efficiency(seq_time, summary)
@@ -66,36 +66,28 @@ int find_nearest_cluster(int     numClusters, /* no. clusters */
     return(index);
 }
 
-/*----< seq_kmeans() >-------------------------------------------------------*/
-/* return an array of cluster centers of size [numClusters][numCoords]       */
-int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
-               int     numCoords,    /* no. features */
-               int     numObjs,      /* no. objects */
-               int     numClusters,  /* no. clusters */
-               float   threshold,    /* % objects change membership */
-               int    *membership,   /* out: [numObjs] */
-               float **clusters)     /* out: [numClusters][numCoords] */
-
+/*----< seq_kmeans_run() >---------------------------------------------------*/
+/* seq_kmeans() on caller-provided accumulators, which it leaves cleared      */
+int seq_kmeans_run(float **objects,      /* in: [numObjs][numCoords] */
+                   int     numCoords,    /* no. features */
+                   int     numObjs,      /* no. objects */
+                   int     numClusters,  /* no. clusters */
+                   float   threshold,    /* % objects change membership */
+                   int    *membership,   /* out: [numObjs] */
+                   float **clusters,     /* out: [numClusters][numCoords] */
+                   int    *newClusterSize, /* [numClusters]: no. objects assigned
+                                              in each new cluster */
+                   float  *newClusters)  /* [numClusters * numCoords] */
 {
     int      i, j, index, loop=0;
-    int     *newClusterSize; /* [numClusters]: no. objects assigned in each
-                                new cluster */
     float    delta;          /* % of objects change their clusters */
-    float  **newClusters;    /* [numClusters][numCoords] */
 
     /* initialize membership[] */
     for (i=0; i<numObjs; i++) membership[i] = -1;
 
-    /* need to initialize newClusterSize and newClusters[0] to all 0 */
-    newClusterSize = (int*) calloc(numClusters, sizeof(int));
-    assert(newClusterSize != NULL);
-
-    newClusters    = (float**) malloc(numClusters *            sizeof(float*));
-    assert(newClusters != NULL);
-    newClusters[0] = (float*)  calloc(numClusters * numCoords, sizeof(float));
-    assert(newClusters[0] != NULL);
-    for (i=1; i<numClusters; i++)
-        newClusters[i] = newClusters[i-1] + numCoords;
+    /* need to initialize newClusterSize and newClusters to all 0 */
+    for (i=0; i<numClusters; i++) newClusterSize[i] = 0;
+    for (i=0; i<numClusters * numCoords; i++) newClusters[i] = 0.0;
 
     do {
         delta = 0.0;
@@ -113,15 +105,15 @@ int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
             /* update new cluster center : sum of objects located within */
             newClusterSize[index]++;
             for (j=0; j<numCoords; j++)
-                newClusters[index][j] += objects[i][j];
+                newClusters[index*numCoords + j] += objects[i][j];
         }
 
         /* average the sum and replace old cluster center with newClusters */
         for (i=0; i<numClusters; i++) {
             for (j=0; j<numCoords; j++) {
                 if (newClusterSize[i] > 0)
-                    clusters[i][j] = newClusters[i][j] / newClusterSize[i];
-                newClusters[i][j] = 0.0;   /* set back to 0 */
+                    clusters[i][j] = newClusters[i*numCoords + j] / newClusterSize[i];
+                newClusters[i*numCoords + j] = 0.0;   /* set back to 0 */
             }
             newClusterSize[i] = 0;   /* set back to 0 */
         }
@@ -129,10 +121,35 @@ int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
         delta /= numObjs;
     } while (delta > threshold && loop++ < 500);
 
-    free(newClusters[0]);
+    return(loop + 1);
+}
+
+/*----< seq_kmeans() >-------------------------------------------------------*/
+/* return an array of cluster centers of size [numClusters][numCoords]       */
+int seq_kmeans(float **objects,      /* in: [numObjs][numCoords] */
+               int     numCoords,    /* no. features */
+               int     numObjs,      /* no. objects */
+               int     numClusters,  /* no. clusters */
+               float   threshold,    /* % objects change membership */
+               int    *membership,   /* out: [numObjs] */
+               float **clusters)     /* out: [numClusters][numCoords] */
+
+{
+    int     *newClusterSize; /* [numClusters]: no. objects assigned in each
+                                new cluster */
+    float   *newClusters;    /* [numClusters][numCoords] */
+    int      loop;
+
+    newClusterSize = (int*)   malloc(numClusters * sizeof(int));
+    assert(newClusterSize != NULL);
+    newClusters    = (float*) malloc(numClusters * numCoords * sizeof(float));
+    assert(newClusters != NULL);
+
+    loop = seq_kmeans_run(objects, numCoords, numObjs, numClusters, threshold,
+                          membership, clusters, newClusterSize, newClusters);
+
     free(newClusters);
     free(newClusterSize);
 
-    return 1;
+    return(loop);
 }
-
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kmeans.h"
+
+/* Sparse input formats, read with -x:
+ *   text  : one object per line, "id col:value col:value ...", with 0-based
+ *           column ids; numCoords is the largest column id + 1
+ *   binary: int numObjs, int numCoords, 8-byte nnz, then the CSR arrays:
+ *           8-byte rowStart[numObjs + 1], int colIdx[nnz], float values[nnz]
+ * In both, a column id may appear at most once per object.
+ */
+
+void sparse_free(kmeans_csr *data) {
+    if (data == NULL) return;
+    free(data->rowStart);
+    free(data->colIdx);
+    free(data->values);
+    free(data);
+}
+
+static kmeans_csr* sparse_alloc(int numObjs, long nnz) {
+    kmeans_csr *data = (kmeans_csr*) calloc(1, sizeof(kmeans_csr));
+    if (data == NULL) return NULL;
+
+    data->numObjs  = numObjs;
+    data->nnz      = nnz;
+    data->rowStart = (long*)  malloc(((size_t)numObjs + 1) * sizeof(long));
+    data->colIdx   = (int*)   malloc((nnz > 0 ? (size_t)nnz : 1) * sizeof(int));
+    data->values   = (float*) malloc((nnz > 0 ? (size_t)nnz : 1) * sizeof(float));
+    if (data->rowStart == NULL || data->colIdx == NULL || data->values == NULL) {
+        sparse_free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static kmeans_csr* sparse_read_binary(char *filename) {
+    FILE       *fp = fopen(filename, "rb");
+    kmeans_csr *data;
+    int         numObjs, numCoords;
+    long        nnz;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return NULL;
+    }
+    if (fread(&numObjs, sizeof(int), 1, fp) != 1 || fread(&numCoords, sizeof(int), 1, fp) != 1 ||
+        fread(&nnz, sizeof(long), 1, fp) != 1 || numObjs <= 0 || numCoords <= 0 || nnz < 0) {
+        fprintf(stderr, "Error: %s is not a sparse binary file\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+
+    data = sparse_alloc(numObjs, nnz);
+    if (data == NULL) {
+        fclose(fp);
+        return NULL;
+    }
+    data->numCoords = numCoords;
+
+    if (fread(data->rowStart, sizeof(long), numObjs + 1, fp) != (size_t)numObjs + 1 ||
+        fread(data->colIdx, sizeof(int), nnz, fp) != (size_t)nnz ||
+        fread(data->values, sizeof(float), nnz, fp) != (size_t)nnz) {
+        fprintf(stderr, "Error: %s is truncated\n", filename);
+        sparse_free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    /* reject anything the kernels would index out of bounds with */
+    if (data->rowStart[0] != 0 || data->rowStart[numObjs] != nnz) {
+        fprintf(stderr, "Error: %s has inconsistent row offsets\n", filename);
+        sparse_free(data);
+        return NULL;
+    }
+    for (int i = 0; i < numObjs; i++)
+        if (data->rowStart[i + 1] < data->rowStart[i]) {
+            fprintf(stderr, "Error: %s has inconsistent row offsets\n", filename);
+            sparse_free(data);
+            return NULL;
+        }
+    for (long k = 0; k < nnz; k++)
+        if (data->colIdx[k] < 0 || data->colIdx[k] >= numCoords) {
+            fprintf(stderr, "Error: %s has a column id out of range\n", filename);
+            sparse_free(data);
+            return NULL;
+        }
+
+    return data;
+}
+
+static kmeans_csr* sparse_read_text(char *filename) {
+    FILE       *fp = fopen(filename, "r");
+    kmeans_csr *data;
+    char       *line = NULL, *tok;
+    size_t      lineLen = 0;
+    int         numObjs = 0, maxCol = -1;
+    long        nnz = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return NULL;
+    }
+
+    /* first pass: count objects and non-zeros, find the widest column */
+    while (getline(&line, &lineLen, fp) != -1) {
+        if (strtok(line, " \t\n") == NULL) continue;
+        numObjs++;
+        while ((tok = strtok(NULL, " \t\n")) != NULL) {
+            int col = atoi(tok);
+            if (strchr(tok, ':') == NULL || col < 0) {
+                fprintf(stderr, "Error: %s: object %d: expected col:value, got \"%s\"\n",
+                        filename, numObjs - 1, tok);
+                free(line);
+                fclose(fp);
+                return NULL;
+            }
+            if (col > maxCol) maxCol = col;
+            nnz++;
+        }
+    }
+    if (numObjs == 0 || maxCol < 0) {
+        fprintf(stderr, "Error: %s holds no non-zero values\n", filename);
+        free(line);
+        fclose(fp);
+        return NULL;
+    }
+
+    data = sparse_alloc(numObjs, nnz);
+    if (data == NULL) {
+        free(line);
+        fclose(fp);
+        return NULL;
+    }
+    data->numCoords = maxCol + 1;
+
+    /* second pass: fill the CSR arrays */
+    rewind(fp);
+    int  i = 0;
+    long k = 0;
+    while (getline(&line, &lineLen, fp) != -1) {
+        if (strtok(line, " \t\n") == NULL) continue;
+        data->rowStart[i++] = k;
+        while ((tok = strtok(NULL, " \t\n")) != NULL) {
+            data->colIdx[k] = atoi(tok);
+            data->values[k] = (float) atof(strchr(tok, ':') + 1);
+            k++;
+        }
+    }
+    data->rowStart[i] = k;
+    assert(i == numObjs && k == nnz);
+
+    free(line);
+    fclose(fp);
+
+    return data;
+}
+
+/* The kernels add up every entry of a row, while the dense copy of an
+ * initial center keeps only the last one, so a column may appear at most
+ * once per object. Returns the first object that repeats one, or -1.
+ */
+static int sparse_find_duplicate(const kmeans_csr *data, int *column) {
+    int *lastObj = (int*) malloc((size_t)data->numCoords * sizeof(int));
+    int  found   = -1;
+
+    assert(lastObj != NULL);
+    for (int j = 0; j < data->numCoords; j++)
+        lastObj[j] = -1;
+    for (int i = 0; i < data->numObjs && found < 0; i++)
+        for (long k = data->rowStart[i]; k < data->rowStart[i + 1]; k++) {
+            if (lastObj[data->colIdx[k]] == i) {
+                *column = data->colIdx[k];
+                found   = i;
+                break;
+            }
+            lastObj[data->colIdx[k]] = i;
+        }
+
+    free(lastObj);
+    return found;
+}
+
+/*---< sparse_read() >-------------------------------------------------------*/
+kmeans_csr* sparse_read(int isBinaryFile, char *filename) {
+    kmeans_csr *data = isBinaryFile ? sparse_read_binary(filename) : sparse_read_text(filename);
+    int         obj, column;
+
+    if (data != NULL && (obj = sparse_find_duplicate(data, &column)) >= 0) {
+        fprintf(stderr, "Error: %s: object %d repeats column %d\n", filename, obj, column);
+        sparse_free(data);
+        return NULL;
+    }
+
+    if (data != NULL && _debug) {
+        printf("File %s numObjs   = %d\n", filename, data->numObjs);
+        printf("File %s numCoords = %d\n", filename, data->numCoords);
+        printf("File %s nnz       = %ld\n", filename, data->nnz);
+    }
+
+    return data;
+}
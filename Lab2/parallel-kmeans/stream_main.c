@@ -0,0 +1,542 @@
+/* Streaming k-means service: follows a growing binary data file (or a
+ * pipe), assigns every newly appended object to its nearest center and
+ * updates that center's running sum and count incrementally. A background
+ * thread periodically refines the model with a full omp_kmeans() pass over
+ * everything seen so far, and the centers are snapshotted to disk.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt(), read(), usleep() */
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+#define STREAM_BLOCK_ROWS 65536   /* objects per storage block */
+#define STREAM_POLL_USEC  100000  /* wait at the end of a regular file */
+
+int _debug;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* The model and every object received so far. Objects are copied into
+ * fixed-size blocks that never move, so a refinement can work on a copy of
+ * the row pointers while new objects keep arriving. lock protects
+ * everything below it.
+ */
+typedef struct {
+    int      numCoords;
+    int      numClusters;
+    float    threshold;
+    double   refineInterval;      /* seconds between refinements, 0: never */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    int      stopping;
+
+    float  **rows;                /* [capRows] */
+    long     numRows, capRows;
+    float  **blocks;
+    int      numBlocks, capBlocks;
+    int     *membership;          /* [capRows] */
+    float  **clusters;            /* [numClusters][numCoords] */
+    double  *sums;                /* [numClusters][numCoords] */
+    long    *counts;              /* [numClusters] */
+
+    long     refinements;
+    long     refinedRows;         /* objects seen by the last refinement */
+    int      lastIterations;
+    double   lastRefineTime;
+} stream_model;
+
+__inline static float euclid_dist_2(int numdims, float *coord1, float *coord2) {
+    float ans = 0.0f;
+
+    for (int i = 0; i < numdims; i++) {
+        float diff = coord1[i] - coord2[i];
+        ans += diff * diff;
+    }
+
+    return ans;
+}
+
+__inline static int find_nearest_cluster(int numClusters,
+                                         int numCoords,
+                                         float *object,
+                                         float **clusters) {
+    int   index    = 0;
+    float min_dist = euclid_dist_2(numCoords, object, clusters[0]);
+
+    for (int i = 1; i < numClusters; i++) {
+        float dist = euclid_dist_2(numCoords, object, clusters[i]);
+        if (dist < min_dist) {
+            min_dist = dist;
+            index    = i;
+        }
+    }
+
+    return index;
+}
+
+static float** alloc_matrix(int numRows, int numCoords) {
+    float **m = (float**) malloc(numRows * sizeof(float*));
+    assert(m != NULL);
+    m[0] = (float*) calloc((size_t)numRows * numCoords, sizeof(float));
+    assert(m[0] != NULL);
+    for (int i = 1; i < numRows; i++)
+        m[i] = m[i - 1] + numCoords;
+    return m;
+}
+
+/* Append one object to the storage; called with the lock held */
+static float* store_row(stream_model *m, const float *obj) {
+    long n = m->numRows;
+
+    if (n == m->capRows) {
+        m->capRows    = (m->capRows == 0) ? STREAM_BLOCK_ROWS : 2 * m->capRows;
+        m->rows       = (float**) realloc(m->rows, m->capRows * sizeof(float*));
+        m->membership = (int*)    realloc(m->membership, m->capRows * sizeof(int));
+        assert(m->rows != NULL && m->membership != NULL);
+    }
+    if (n % STREAM_BLOCK_ROWS == 0) {
+        if (m->numBlocks == m->capBlocks) {
+            m->capBlocks = (m->capBlocks == 0) ? 16 : 2 * m->capBlocks;
+            m->blocks    = (float**) realloc(m->blocks, m->capBlocks * sizeof(float*));
+            assert(m->blocks != NULL);
+        }
+        m->blocks[m->numBlocks] =
+            (float*) malloc((size_t)STREAM_BLOCK_ROWS * m->numCoords * sizeof(float));
+        assert(m->blocks[m->numBlocks] != NULL);
+        m->numBlocks++;
+    }
+
+    float *row = m->blocks[n / STREAM_BLOCK_ROWS] + (n % STREAM_BLOCK_ROWS) * m->numCoords;
+    memcpy(row, obj, m->numCoords * sizeof(float));
+    m->rows[n] = row;
+    m->numRows++;
+
+    return row;
+}
+
+/* Add objects [first, numRows) to the running sums and counts and move the
+ * centers they touched; called with the lock held.
+ */
+static void absorb_rows(stream_model *m, long first) {
+    int numCoords = m->numCoords;
+
+    for (long i = first; i < m->numRows; i++) {
+        int     c   = m->membership[i];
+        double *sum = m->sums + (size_t)c * numCoords;
+
+        m->counts[c]++;
+        for (int j = 0; j < numCoords; j++)
+            sum[j] += m->rows[i][j];
+    }
+    for (long i = first; i < m->numRows; i++) {
+        int     c   = m->membership[i];
+        double *sum = m->sums + (size_t)c * numCoords;
+
+        for (int j = 0; j < numCoords; j++)
+            m->clusters[c][j] = (float)(sum[j] / m->counts[c]);
+    }
+}
+
+/* Ingest a batch of objects: the first numClusters become the initial
+ * centers (as objects[0..K-1] do in omp_main), later ones are assigned in
+ * parallel and absorbed into the model.
+ */
+static void ingest(stream_model *m, const float *batch, int numNew) {
+    int numCoords = m->numCoords, numClusters = m->numClusters;
+
+    pthread_mutex_lock(&m->lock);
+
+    long first = m->numRows;
+    for (int b = 0; b < numNew; b++)
+        store_row(m, batch + (size_t)b * numCoords);
+
+    /* seed the centers from the first objects */
+    long i = first;
+    for (; i < m->numRows && i < numClusters; i++) {
+        memcpy(m->clusters[i], m->rows[i], numCoords * sizeof(float));
+        m->membership[i] = (int)i;
+    }
+    if (i < numClusters) {
+        pthread_mutex_unlock(&m->lock);
+        return;
+    }
+    if (first < numClusters) {
+        /* every seed is its own cluster's first member */
+        for (int c = 0; c < numClusters; c++) {
+            m->counts[c] = 1;
+            for (int j = 0; j < numCoords; j++)
+                m->sums[(size_t)c * numCoords + j] = m->clusters[c][j];
+        }
+    }
+
+    long    start = i;
+    float **rows  = m->rows;
+    int    *memb  = m->membership;
+    float **cl    = m->clusters;
+    #pragma omp parallel for schedule(static)
+    for (long k = start; k < m->numRows; k++)
+        memb[k] = find_nearest_cluster(numClusters, numCoords, rows[k], cl);
+
+    absorb_rows(m, start);
+
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* One full Lloyd pass over the first n objects, started from the current
+ * centers; the result replaces the model, and objects that arrived in the
+ * meantime are reassigned to the refined centers. Nothing is done if no
+ * object arrived since the last refinement.
+ */
+static void refine(stream_model *m) {
+    int    numCoords = m->numCoords, numClusters = m->numClusters;
+    long   n;
+    float **rows, **clusters = alloc_matrix(numClusters, numCoords);
+    double  t = wtime();
+
+    pthread_mutex_lock(&m->lock);
+    n = m->numRows;
+    if (n <= numClusters || n == m->refinedRows) {
+        pthread_mutex_unlock(&m->lock);
+        free(clusters[0]);
+        free(clusters);
+        return;
+    }
+    rows = (float**) malloc(n * sizeof(float*));
+    assert(rows != NULL);
+    memcpy(rows, m->rows, n * sizeof(float*));
+    memcpy(clusters[0], m->clusters[0], (size_t)numClusters * numCoords * sizeof(float));
+    pthread_mutex_unlock(&m->lock);
+
+    int *membership = (int*) malloc(n * sizeof(int));
+    assert(membership != NULL);
+    int iterations = omp_kmeans(rows, numCoords, (int)n, numClusters, m->threshold,
+                                membership, clusters, NULL);
+
+    if (iterations > 0) {
+        pthread_mutex_lock(&m->lock);
+
+        memcpy(m->clusters[0], clusters[0], (size_t)numClusters * numCoords * sizeof(float));
+        memcpy(m->membership, membership, n * sizeof(int));
+        memset(m->sums, 0, (size_t)numClusters * numCoords * sizeof(double));
+        memset(m->counts, 0, numClusters * sizeof(long));
+
+        /* rebuild the sums from the refined memberships; empty clusters
+         * keep their refined centers
+         */
+        long    total = m->numRows;
+        float **all   = m->rows;
+        int    *memb  = m->membership;
+        float **cl    = m->clusters;
+        #pragma omp parallel for schedule(static)
+        for (long k = n; k < total; k++)
+            memb[k] = find_nearest_cluster(numClusters, numCoords, all[k], cl);
+        absorb_rows(m, 0);
+
+        m->refinements++;
+        m->refinedRows    = n;
+        m->lastIterations = iterations;
+        m->lastRefineTime = wtime() - t;
+
+        pthread_mutex_unlock(&m->lock);
+    }
+
+    free(membership);
+    free(rows);
+    free(clusters[0]);
+    free(clusters);
+}
+
+static void* refine_thread(void *arg) {
+    stream_model *m = (stream_model*) arg;
+
+    pthread_mutex_lock(&m->lock);
+    while (!m->stopping) {
+        struct timespec until;
+        double          wake = wtime() + m->refineInterval;
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec  += (time_t)m->refineInterval;
+        until.tv_nsec += (long)((m->refineInterval - (long)m->refineInterval) * 1e9);
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        while (!m->stopping && wtime() < wake)
+            if (pthread_cond_timedwait(&m->wake, &m->lock, &until) == ETIMEDOUT) break;
+        if (m->stopping) break;
+
+        pthread_mutex_unlock(&m->lock);
+        refine(m);
+        pthread_mutex_lock(&m->lock);
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    return NULL;
+}
+
+/* Write the centers to filename in the format of .cluster_centres, through
+ * a rename so readers never see a partial file.
+ */
+static int write_snapshot(stream_model *m, const char *filename) {
+    char  tmpName[1024];
+    FILE *fp;
+
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", filename);
+    if ((fp = fopen(tmpName, "w")) == NULL) {
+        fprintf(stderr, "Error: cannot create snapshot %s\n", tmpName);
+        return 0;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    for (int c = 0; c < m->numClusters; c++) {
+        fprintf(fp, "%d ", c);
+        for (int j = 0; j < m->numCoords; j++)
+            fprintf(fp, "%f ", m->clusters[c][j]);
+        fprintf(fp, "\n");
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    fclose(fp);
+    if (rename(tmpName, filename) != 0) {
+        fprintf(stderr, "Error: cannot rename %s to %s\n", tmpName, filename);
+        return 0;
+    }
+    return 1;
+}
+
+static void usage(char *argv0, float threshold) {
+    char *help =
+        "Usage: %s [switches] -i filename -n num_clusters\n"
+        "       -i filename    : binary data file to follow as it grows, or - for\n"
+        "                        a pipe on stdin (same format, header first)\n"
+        "       -n num_clusters: number of clusters (K must > 1); the first K\n"
+        "                        objects are the initial centers\n"
+        "       -t threshold   : threshold of the refinements (default %.4f)\n"
+        "       -p nproc       : number of OpenMP threads (default: runtime)\n"
+        "       -B batch       : max. objects ingested at a time (default: 4096)\n"
+        "       -R seconds     : full Lloyd refinement period, 0 = never (default: 10)\n"
+        "       -s snapshot    : centers snapshot file (default: filename.snapshot)\n"
+        "       -I seconds     : snapshot period (default: 5)\n"
+        "       -E seconds     : stop after this long without new data, 0 = never\n"
+        "                        (default: 0; a pipe stops at end of input,\n"
+        "                        a file on SIGINT/SIGTERM)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, threshold);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    extern char   *optarg;
+    int            opt, numThreads = 0, batchSize = 4096, verbose = 1, isPipe, fd;
+    int            header[2];
+    double         snapshotInterval = 5.0, idleLimit = 0.0;
+    char          *filename = NULL, *snapshotName = NULL, outName[1024];
+    stream_model   m;
+    pthread_t      refiner;
+    struct stat    st;
+
+    memset(&m, 0, sizeof(m));
+    m.threshold      = 0.001f;
+    m.refineInterval = 10.0;
+    _debug           = 0;
+
+    while ((opt = getopt(argc, argv, "i:n:t:p:B:R:s:I:E:qdh")) != EOF) {
+        switch (opt) {
+            case 'i': filename         = optarg;             break;
+            case 'n': m.numClusters    = atoi(optarg);       break;
+            case 't': m.threshold      = atof(optarg);       break;
+            case 'p': numThreads       = atoi(optarg);       break;
+            case 'B': batchSize        = atoi(optarg);       break;
+            case 'R': m.refineInterval = atof(optarg);       break;
+            case 's': snapshotName     = optarg;             break;
+            case 'I': snapshotInterval = atof(optarg);       break;
+            case 'E': idleLimit        = atof(optarg);       break;
+            case 'q': verbose          = 0;                  break;
+            case 'd': _debug           = 1;                  break;
+            case 'h':
+            default: usage(argv[0], m.threshold);            break;
+        }
+    }
+    if (filename == NULL || m.numClusters <= 1 || batchSize < 1 ||
+        m.refineInterval < 0.0 || snapshotInterval <= 0.0)
+        usage(argv[0], m.threshold);
+
+    if (numThreads > 0) omp_set_num_threads(numThreads);
+
+    if (strcmp(filename, "-") == 0) {
+        fd = STDIN_FILENO;
+        snprintf(outName, sizeof(outName), "stdin");
+    } else if ((fd = open(filename, O_RDONLY)) == -1) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return 1;
+    } else {
+        snprintf(outName, sizeof(outName), "%s", filename);
+    }
+    if (snapshotName == NULL) {
+        snapshotName = (char*) malloc(strlen(outName) + 10);
+        assert(snapshotName != NULL);
+        sprintf(snapshotName, "%s.snapshot", outName);
+    }
+    isPipe = (fstat(fd, &st) == 0 && !S_ISREG(st.st_mode));
+
+    /* the header's numObjs is stale for a growing file; only numCoords
+     * matters (wait for it to be written)
+     */
+    size_t have = 0;
+    while (have < sizeof(header)) {
+        ssize_t got = read(fd, (char*)header + have, sizeof(header) - have);
+        if (got < 0 && errno != EINTR) { perror("read"); return 1; }
+        if (got == 0 && (isPipe || stop_requested)) {
+            fprintf(stderr, "Error: %s ended before its header\n", filename);
+            return 1;
+        }
+        if (got == 0) usleep(STREAM_POLL_USEC);
+        if (got > 0) have += got;
+    }
+    m.numCoords = header[1];
+    if (m.numCoords <= 0) {
+        fprintf(stderr, "Error: %s: bad number of coordinates %d\n", filename, m.numCoords);
+        return 1;
+    }
+
+    m.clusters = alloc_matrix(m.numClusters, m.numCoords);
+    m.sums     = (double*) calloc((size_t)m.numClusters * m.numCoords, sizeof(double));
+    m.counts   = (long*)   calloc(m.numClusters, sizeof(long));
+    assert(m.sums != NULL && m.counts != NULL);
+    pthread_mutex_init(&m.lock, NULL);
+    pthread_cond_init(&m.wake, NULL);
+
+    /* no SA_RESTART: a signal must interrupt a read() blocked on a pipe.
+     * That only works if the signal goes to this thread, so it is blocked
+     * while the refiner and the OpenMP team are started (they inherit the
+     * mask and never take it) and unblocked here alone afterwards.
+     */
+    struct sigaction sa;
+    sigset_t         stopSignals;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (m.refineInterval > 0.0)
+        pthread_create(&refiner, NULL, refine_thread, &m);
+    #pragma omp parallel
+    {
+        /* start the team's threads now, with the signals still blocked */
+    }
+    pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+
+    if (verbose)
+        printf("following %s: %d coordinates, K=%d, snapshots to %s\n",
+               isPipe ? "stdin" : filename, m.numCoords, m.numClusters, snapshotName);
+
+    /* ingestion loop: whole records are handed to ingest(), a partial one
+     * stays at the front of the buffer until the rest arrives
+     */
+    size_t  recordBytes  = (size_t)m.numCoords * sizeof(float);
+    size_t  bufferBytes  = (size_t)batchSize * recordBytes;
+    float  *batch        = (float*) malloc(bufferBytes);
+    double  start        = wtime(), lastData = start, lastSnapshot = start;
+    long    lastReported = 0;
+    assert(batch != NULL);
+
+    have = 0;
+    while (!stop_requested) {
+        ssize_t got = read(fd, (char*)batch + have, bufferBytes - have);
+
+        if (got < 0 && errno != EINTR) {
+            perror("read");
+            break;
+        }
+        if (got > 0) {
+            have    += got;
+            lastData = wtime();
+
+            int numNew = (int)(have / recordBytes);
+            if (numNew > 0) {
+                ingest(&m, batch, numNew);
+                memmove(batch, (char*)batch + numNew * recordBytes, have - numNew * recordBytes);
+                have -= numNew * recordBytes;
+            }
+        } else if (got == 0) {
+            if (isPipe) break;
+            if (idleLimit > 0.0 && wtime() - lastData >= idleLimit) break;
+            usleep(STREAM_POLL_USEC);
+        }
+
+        if (wtime() - lastSnapshot >= snapshotInterval) {
+            write_snapshot(&m, snapshotName);
+            lastSnapshot = wtime();
+
+            pthread_mutex_lock(&m.lock);
+            if (verbose && m.numRows != lastReported)
+                printf("[%8.1f s] %ld objects, %ld refinements (last: %d iterations, %.3f sec)\n",
+                       lastSnapshot - start, m.numRows, m.refinements, m.lastIterations,
+                       m.lastRefineTime);
+            lastReported = m.numRows;
+            pthread_mutex_unlock(&m.lock);
+        }
+    }
+    if (have % recordBytes != 0)
+        fprintf(stderr, "Warning: ignoring a partial record of %zu bytes at the end\n",
+                have % recordBytes);
+    free(batch);
+
+    if (m.refineInterval > 0.0) {
+        pthread_mutex_lock(&m.lock);
+        m.stopping = 1;
+        pthread_cond_signal(&m.wake);
+        pthread_mutex_unlock(&m.lock);
+        pthread_join(refiner, NULL);
+    }
+
+    if (m.numRows < m.numClusters) {
+        fprintf(stderr, "Error: only %ld objects received, fewer than K=%d\n",
+                m.numRows, m.numClusters);
+        return 1;
+    }
+
+    /* a last refinement, so the final model is a converged one */
+    refine(&m);
+    write_snapshot(&m, snapshotName);
+    file_write(outName, m.numClusters, (int)m.numRows, m.numCoords, m.clusters,
+               m.membership, verbose);
+
+    if (verbose)
+        printf("%ld objects in %.3f sec, %ld refinements\n", m.numRows, wtime() - start,
+               m.refinements);
+
+    if (fd != STDIN_FILENO) close(fd);
+    for (int b = 0; b < m.numBlocks; b++)
+        free(m.blocks[b]);
+    free(m.blocks);
+    free(m.rows);
+    free(m.membership);
+    free(m.clusters[0]);
+    free(m.clusters);
+    free(m.sums);
+    free(m.counts);
+
+    return 0;
+}
@@ -17,6 +17,10 @@ Options:
                         (default: "1 2 4 8")
   -b, --binary          Treat the input as binary (-b flag for the executables)
   -a, --atomic          Enable the atomic accumulation path in omp_main (-a)
+      --shards N        Atomic accumulation into N replicas, e.g. one per
+                        socket (-A N; implies --atomic)
+      --repro           Use the reproducible reduction in omp_main (-r); the
+                        centroids must then be identical for every thread count
       --outdir DIR      Base directory for run artifacts and logs (default: logs)
   -r, --runs N          Number of runs to average (default: 10)
   -h, --help            Show this help and exit
@@ -32,6 +36,8 @@ THRESHOLD=0.001
 THREADS="1 4 8 14 28 56"
 IS_BINARY=0
 USE_ATOMIC=0
+USE_REPRO=0
+SHARDS=0
 OUTDIR="runs"
 ROUNDS=10
 
@@ -61,6 +67,15 @@ while [[ $# -gt 0 ]]; do
             USE_ATOMIC=1
             shift
             ;;
+        --shards)
+            USE_ATOMIC=1
+            SHARDS="$2"
+            shift 2
+            ;;
+        --repro)
+            USE_REPRO=1
+            shift
+            ;;
         --outdir)
             OUTDIR="$2"
             shift 2
@@ -171,6 +186,7 @@ declare -a SUMMARY_MEMBERSHIP=()
 declare -a SUMMARY_CENTROIDS=()
 
 STATUS=0
+REPRO_REF=""
 
 for T in $THREADS; do
     RUN_ART_DIR="$ARTIFACTS_DIR/omp_t${T}"
@@ -181,9 +197,14 @@ for T in $THREADS; do
     if (( IS_BINARY == 1 )); then
         omp_cmd+=(-b)
     fi
-    if (( USE_ATOMIC == 1 )); then
+    if (( SHARDS > 1 )); then
+        omp_cmd+=(-A "$SHARDS")
+    elif (( USE_ATOMIC == 1 )); then
         omp_cmd+=(-a)
     fi
+    if (( USE_REPRO == 1 )); then
+        omp_cmd+=(-r)
+    fi
 
     OMP_LOG="$LOG_DIR/run_t${T}.log"
     : > "$OMP_LOG"
@@ -216,6 +237,16 @@ for T in $THREADS; do
         cp "$CLUSTER_FILE" "$RUN_SUBDIR/$(basename "$CLUSTER_FILE")"
         cp "$MEMBERSHIP_FILE" "$RUN_SUBDIR/$(basename "$MEMBERSHIP_FILE")"
 
+        # --- reproducible mode: every run must match the first one bit for bit ---
+        if (( USE_REPRO == 1 )); then
+            if [[ -z "$REPRO_REF" ]]; then
+                REPRO_REF="$RUN_SUBDIR/$(basename "$CLUSTER_FILE")"
+            elif ! cmp -s "$REPRO_REF" "$RUN_SUBDIR/$(basename "$CLUSTER_FILE")"; then
+                echo "Centroids of run #$i with $T threads differ from $REPRO_REF" >&2
+                STATUS=1
+            fi
+        fi
+
         run_time="$(awk '/Computation timing/ {print $(NF-1)}' "$OMP_LOG" | tail -n1)"
         if [[ -z "$run_time" ]]; then
             run_time="NA"
@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <omp.h>
+
+#include "kmeans.h"
+
+/* Read a single integer from a sysfs file; returns -1 if it is unavailable */
+static int read_sysfs_int(const char *path) {
+    FILE *fp = fopen(path, "r");
+    int   value;
+
+    if (fp == NULL) return -1;
+    if (fscanf(fp, "%d", &value) != 1) value = -1;
+    fclose(fp);
+
+    return value;
+}
+
+/* physical package (socket) id of a cpu, 0 if sysfs does not report one */
+int topology_cpu_socket(int cpu) {
+    char path[128];
+    int  socket;
+
+    if (cpu < 0) return 0;
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    socket = read_sysfs_int(path);
+
+    return (socket < 0) ? 0 : socket;
+}
+
+/* socket of the cpu the calling thread is running on right now, from the
+ * table of topology_cpus() (no file access once that has been built)
+ */
+int topology_current_socket(void) {
+    const topology_cpu *cpus;
+    int                 n = topology_cpus(&cpus), cpu = sched_getcpu();
+
+    for (int i = 0; i < n; i++)
+        if (cpus[i].cpu == cpu) return cpus[i].socket;
+    return topology_cpu_socket(cpu);
+}
+
+/* Every cpu the process may run on, with its socket, physical core and
+ * whether it is an efficiency core. Discovered once, before any pinning
+ * narrows the affinity mask of the calling thread, and sorted by
+ * (efficiency, socket, core, cpu) so performance cores come first and SMT
+ * siblings are adjacent.
+ */
+static topology_cpu *allCpus = NULL;
+static int           numAllCpus = 0;
+
+/* parse a sysfs cpu list such as "0-3,8,10-11" into flags[cpu] = 1 */
+static void parse_cpu_list(const char *path, char *flags, int maxCpu) {
+    FILE *fp = fopen(path, "r");
+    int   lo, hi;
+    char  sep;
+
+    if (fp == NULL) return;
+    while (fscanf(fp, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(fp, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(fp, "%d", &hi) != 1) break;
+            if (fscanf(fp, "%c", &sep) != 1) sep = '\n';
+        }
+        for (int c = lo; c <= hi && c < maxCpu; c++)
+            if (c >= 0) flags[c] = 1;
+        if (sep != ',') break;
+    }
+    fclose(fp);
+}
+
+static int compare_cpus(const void *a, const void *b) {
+    const topology_cpu *x = (const topology_cpu*) a, *y = (const topology_cpu*) b;
+
+    if (x->efficiency != y->efficiency) return x->efficiency - y->efficiency;
+    if (x->socket != y->socket)         return x->socket - y->socket;
+    if (x->core != y->core)             return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+/* Efficiency cores are the ones the hybrid PMU lists under cpu_atom (Intel)
+ * or, failing that, the ones with less than the largest cpu_capacity
+ * (big.LITTLE); without either every core counts as a performance core.
+ */
+int topology_cpus(const topology_cpu **cpus) {
+    if (allCpus == NULL) {
+        cpu_set_t mask;
+        char      path[128], *atom;
+        int       maxCapacity = -1;
+
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+            CPU_ZERO(&mask);
+            CPU_SET(0, &mask);
+        }
+        allCpus = (topology_cpu*) calloc(CPU_SETSIZE, sizeof(topology_cpu));
+        atom    = (char*) calloc(CPU_SETSIZE, 1);
+        assert(allCpus != NULL && atom != NULL);
+        parse_cpu_list("/sys/devices/cpu_atom/cpus", atom, CPU_SETSIZE);
+
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (!CPU_ISSET(c, &mask)) continue;
+
+            topology_cpu *t = &allCpus[numAllCpus++];
+            t->cpu    = c;
+            t->socket = topology_cpu_socket(c);
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+            t->core   = read_sysfs_int(path);
+            if (t->core < 0) t->core = c;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", c);
+            t->efficiency = read_sysfs_int(path);  /* capacity for now */
+            if (t->efficiency > maxCapacity) maxCapacity = t->efficiency;
+        }
+        for (int i = 0; i < numAllCpus; i++) {
+            topology_cpu *t = &allCpus[i];
+            t->efficiency = atom[t->cpu] || (t->efficiency >= 0 && t->efficiency < maxCapacity);
+        }
+        free(atom);
+
+        qsort(allCpus, numAllCpus, sizeof(topology_cpu), compare_cpus);
+    }
+
+    if (cpus != NULL) *cpus = allCpus;
+    return numAllCpus;
+}
+
+static const char *policy_names[] = { "none", "compact", "scatter", "core" };
+
+const char* topology_policy_name(int policy) {
+    return (policy >= TOPOLOGY_PIN_NONE && policy <= TOPOLOGY_PIN_CORE)
+           ? policy_names[policy] : "unknown";
+}
+
+/* TOPOLOGY_PIN_* of a policy name, -1 if there is none */
+int topology_parse_policy(const char *name) {
+    for (int p = TOPOLOGY_PIN_NONE; p <= TOPOLOGY_PIN_CORE; p++)
+        if (strcmp(name, policy_names[p]) == 0) return p;
+    return -1;
+}
+
+/* Fill order[] with the cpus threads 0, 1, ... are placed on, one entry per
+ * allowed cpu; thread t goes to order[t % n]. Returns n.
+ *   compact: fill a core's SMT siblings, then the next core of the socket
+ *   core   : one thread per physical core first, siblings only after that
+ *   scatter: as core, but consecutive threads alternate between sockets
+ * Performance cores are always used before efficiency cores.
+ */
+int topology_pin_order(int policy, int *order) {
+    const topology_cpu *cpus;
+    int                 n = topology_cpus(&cpus), k = 0;
+
+    if (policy == TOPOLOGY_PIN_COMPACT) {
+        for (int i = 0; i < n; i++)
+            order[i] = cpus[i].cpu;
+        return n;
+    }
+
+    /* rank of each cpu among its core's siblings: 0 for the first one */
+    int *level = (int*) calloc(n, sizeof(int)), maxLevel = 0;
+    assert(level != NULL);
+    for (int i = 1; i < n; i++)
+        if (cpus[i].socket == cpus[i - 1].socket && cpus[i].core == cpus[i - 1].core &&
+            cpus[i].efficiency == cpus[i - 1].efficiency) {
+            level[i] = level[i - 1] + 1;
+            if (level[i] > maxLevel) maxLevel = level[i];
+        }
+
+    for (int l = 0; l <= maxLevel; l++)
+        for (int e = 0; e <= 1; e++) {
+            if (policy == TOPOLOGY_PIN_CORE) {
+                for (int i = 0; i < n; i++)
+                    if (level[i] == l && cpus[i].efficiency == e) order[k++] = cpus[i].cpu;
+                continue;
+            }
+
+            /* scatter: the candidates of a socket are contiguous; take the
+             * round-th one of every socket in turn
+             */
+            for (int round = 0, placed = 1; placed; round++) {
+                int socket = -1, rank = 0;
+
+                placed = 0;
+                for (int i = 0; i < n; i++) {
+                    if (level[i] != l || cpus[i].efficiency != e) continue;
+                    if (cpus[i].socket != socket) {
+                        socket = cpus[i].socket;
+                        rank   = 0;
+                    }
+                    if (rank++ == round) {
+                        order[k++] = cpus[i].cpu;
+                        placed     = 1;
+                    }
+                }
+            }
+        }
+
+    free(level);
+    return k;
+}
+
+/* Pin the threads of a team of nthreads to the cpus of a policy (or unpin
+ * them with TOPOLOGY_PIN_NONE). OpenMP runtimes keep the pool's threads
+ * for later parallel regions of the same size, so the placement holds for
+ * them as long as OMP_PROC_BIND is not set. Returns 1 on success.
+ */
+int topology_pin_threads(int policy, int nthreads) {
+    const topology_cpu *cpus;
+    int                 n = topology_cpus(&cpus), ok = 1;
+    int                *order = (int*) malloc(n * sizeof(int));
+    cpu_set_t           all;
+
+    assert(order != NULL);
+    CPU_ZERO(&all);
+    for (int i = 0; i < n; i++)
+        CPU_SET(cpus[i].cpu, &all);
+    if (policy != TOPOLOGY_PIN_NONE)
+        n = topology_pin_order(policy, order);
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        cpu_set_t mask = all;
+        if (policy != TOPOLOGY_PIN_NONE) {
+            CPU_ZERO(&mask);
+            CPU_SET(order[omp_get_thread_num() % n], &mask);
+        }
+        if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+            #pragma omp atomic write
+            ok = 0;
+        }
+    }
+
+    free(order);
+    return ok;
+}
+
+/* counts of the allowed cpus' physical cores, sockets and efficiency cpus;
+ * returns the number of cpus
+ */
+int topology_summary(int *cores, int *sockets, int *efficiency) {
+    const topology_cpu *cpus;
+    int                 n = topology_cpus(&cpus);
+
+    *cores = *sockets = *efficiency = 0;
+    for (int i = 0; i < n; i++) {
+        int newSocket = 1, newCore = 1;
+        for (int j = 0; j < i; j++) {
+            if (cpus[j].socket != cpus[i].socket) continue;
+            newSocket = 0;
+            if (cpus[j].core == cpus[i].core) newCore = 0;
+        }
+        *sockets    += newSocket;
+        *cores      += newCore;
+        *efficiency += cpus[i].efficiency;
+    }
+
+    return n;
+}
@@ -1,10 +1,23 @@
 /*
 * This sample implements a separable convolution 
 * of a 2D image with an arbitrary filter.
+*
+* Build: gcc -O2 -mavx2 -mfma -fopenmp Convolution2D.c -lm
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__AVX__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 unsigned int filter_radius;
 
@@ -12,6 +25,30 @@ unsigned int filter_radius;
 #define ABS(val)  	((val)<0.0 ? (-(val)) : (val))
 #define accuracy  	0.00005 
 
+// output pixels per step of the fast kernels: two 8-wide AVX registers
+#define SIMD_BLOCK 	16
+
+// bytes of source rows a column strip should keep in cache (about half of a
+// typical L2), and the narrowest strip: four cache lines
+#define STRIP_BYTES 	(256 * 1024)
+#define STRIP_MIN 	64
+
+// output rows the blocked column pass computes per load of a source row
+#define COLUMN_ROWS 	4
+
+// radii with kernels specialized at compile time; the unroll pragmas of
+// those kernels are sized for it (2 * 8 + 1 taps)
+#define MAX_FIXED_RADIUS 8
+
+// tiles of the multi-threaded engine: a tile's row-filtered pixels, halo rows
+// included, stay within a per-thread buffer of about 300 KB for R = 16
+#define TILE_W 		512
+#define TILE_H 		128
+
+// largest FFT tile edge of the FFT engine: two 1024 x 1024 float planes are
+// 8 MB per thread
+#define FFT_MAX 	1024
+
  
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -68,6 +105,1220 @@ void convolutionColumnCPU(float *h_Dst, float *h_Src, float *h_Filter,
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Wall-clock time in seconds
+////////////////////////////////////////////////////////////////////////////////
+static double now(void) {
+  struct timespec tv;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &tv);
+  return tv.tv_sec + tv.tv_nsec * 1e-9;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// SIMD_BLOCK output pixels: dst[i] = sum over k of src[i + k * step] *
+// h_Filter[filterR - k], for k in [kLo, kHi]. src points at the tap k = 0 of
+// the first pixel; the taps in range are the only ones visited, so the loop
+// has no bounds test. The sums stay in registers and are stored once.
+////////////////////////////////////////////////////////////////////////////////
+static inline void convolveBlock(float *dst, const float *src, const float *h_Filter,
+                                 int filterR, int kLo, int kHi, long step) {
+
+  int k;
+
+#if defined(__AVX__) && defined(__FMA__)
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+
+  for (k = kLo; k <= kHi; k++) {
+    __m256 tap = _mm256_broadcast_ss(&h_Filter[filterR - k]);
+
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(src + k * step), tap, sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(src + k * step + 8), tap, sum1);
+  }
+
+  _mm256_storeu_ps(dst, sum0);
+  _mm256_storeu_ps(dst + 8, sum1);
+#else
+  float sum[SIMD_BLOCK] = { 0 };
+  int   i;
+
+  for (k = kLo; k <= kHi; k++) {
+    float tap = h_Filter[filterR - k];
+
+    for (i = 0; i < SIMD_BLOCK; i++) {
+      sum[i] += src[i + k * step] * tap;
+    }
+  }
+
+  for (i = 0; i < SIMD_BLOCK; i++) {
+    dst[i] = sum[i];
+  }
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// One output pixel with the taps limited to [kLo, kHi], for the image borders
+// and the pixels left over after the SIMD_BLOCK steps
+////////////////////////////////////////////////////////////////////////////////
+static inline float convolvePixel(const float *src, const float *h_Filter,
+                                  int filterR, int kLo, int kHi, long step) {
+
+  float sum = 0;
+  int   k;
+
+  for (k = kLo; k <= kHi; k++) {
+    sum += src[k * step] * h_Filter[filterR - k];
+  }
+
+  return sum;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// COLUMN_ROWS output rows by SIMD_BLOCK pixels of the column pass, away from
+// the top and bottom borders. src points at output row 0's pixel, and every
+// source row from -filterR to COLUMN_ROWS - 1 + filterR is loaded once and
+// added into all the output rows; h_Padded is the filter with COLUMN_ROWS - 1
+// zeros on each side, so the rows a source row is out of reach of add zero.
+// The taps are still added in the reference's order.
+////////////////////////////////////////////////////////////////////////////////
+static inline void convolveColumnRows(float *dst, long dstStep, const float *src,
+                                      const float *h_Padded, int filterR, long step) {
+
+  int j, r;
+  const float *tap = h_Padded + COLUMN_ROWS - 1 + 2 * filterR;
+
+#if defined(__AVX__) && defined(__FMA__)
+  __m256 sum[COLUMN_ROWS][2];
+
+  for (r = 0; r < COLUMN_ROWS; r++) {
+    sum[r][0] = _mm256_setzero_ps();
+    sum[r][1] = _mm256_setzero_ps();
+  }
+
+  for (j = -filterR; j < COLUMN_ROWS + filterR; j++) {
+    __m256 lo = _mm256_loadu_ps(src + j * step);
+    __m256 hi = _mm256_loadu_ps(src + j * step + 8);
+
+    // row r uses tap filterR - (j - r) of the filter, tap[r - j] here
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      __m256 f = _mm256_broadcast_ss(&tap[r - j - filterR]);
+
+      sum[r][0] = _mm256_fmadd_ps(lo, f, sum[r][0]);
+      sum[r][1] = _mm256_fmadd_ps(hi, f, sum[r][1]);
+    }
+  }
+
+  for (r = 0; r < COLUMN_ROWS; r++) {
+    _mm256_storeu_ps(dst + r * dstStep, sum[r][0]);
+    _mm256_storeu_ps(dst + r * dstStep + 8, sum[r][1]);
+  }
+#else
+  float sum[COLUMN_ROWS][SIMD_BLOCK] = { { 0 } };
+  int   i;
+
+  for (j = -filterR; j < COLUMN_ROWS + filterR; j++) {
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      float f = tap[r - j - filterR];
+
+      for (i = 0; i < SIMD_BLOCK; i++) {
+        sum[r][i] += src[i + j * step] * f;
+      }
+    }
+  }
+
+  for (r = 0; r < COLUMN_ROWS; r++) {
+    for (i = 0; i < SIMD_BLOCK; i++) {
+      dst[i + r * dstStep] = sum[r][i];
+    }
+  }
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Interior kernels of the fast engines: runs of SIMD_BLOCK-pixel row blocks
+// that have all their taps inside the row, and runs of COLUMN_ROWS x
+// SIMD_BLOCK column blocks. The generic ones take any radius; for radii up to
+// MAX_FIXED_RADIUS, fixed-radius copies are generated at compile time with
+// the taps broadcast into registers once per run and the tap loops fully
+// unrolled. selectKernels() picks them by radius.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+  void (*rowBlocks)(float *dst, const float *src, const float *h_Filter, int filterR,
+                    int blocks);
+  void (*columnBlocks)(float *dst, long dstStep, const float *src, long step,
+                       const float *h_Padded, int filterR, int blocks);
+} convolutionKernels;
+
+// 0 makes selectKernels() return the generic kernels for every radius
+int specializedKernels = 1;
+
+static void rowBlocksGeneric(float *dst, const float *src, const float *h_Filter, int filterR,
+                             int blocks) {
+
+  int b;
+
+  for (b = 0; b < blocks; b++) {
+    convolveBlock(dst + b * SIMD_BLOCK, src + b * SIMD_BLOCK, h_Filter, filterR, -filterR,
+                  filterR, 1);
+  }
+}
+
+static void columnBlocksGeneric(float *dst, long dstStep, const float *src, long step,
+                                const float *h_Padded, int filterR, int blocks) {
+
+  int b;
+
+  for (b = 0; b < blocks; b++) {
+    convolveColumnRows(dst + b * SIMD_BLOCK, dstStep, src + b * SIMD_BLOCK, h_Padded, filterR,
+                       step);
+  }
+}
+
+static inline __attribute__((always_inline))
+void rowBlocksFixed(float *dst, const float *src, const float *h_Filter, const int filterR,
+                    int blocks) {
+
+  int b, k;
+
+#if defined(__AVX__) && defined(__FMA__)
+  __m256 tap[2 * MAX_FIXED_RADIUS + 1];
+
+  #pragma GCC unroll 17
+  for (k = 0; k <= 2 * filterR; k++) {
+    tap[k] = _mm256_broadcast_ss(&h_Filter[k]);
+  }
+
+  for (b = 0; b < blocks; b++, dst += SIMD_BLOCK, src += SIMD_BLOCK) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    #pragma GCC unroll 17
+    for (k = -filterR; k <= filterR; k++) {
+      sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(src + k), tap[filterR - k], sum0);
+      sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(src + k + 8), tap[filterR - k], sum1);
+    }
+
+    _mm256_storeu_ps(dst, sum0);
+    _mm256_storeu_ps(dst + 8, sum1);
+  }
+#else
+  float tap[2 * MAX_FIXED_RADIUS + 1];
+  int   i;
+
+  for (k = 0; k <= 2 * filterR; k++) {
+    tap[k] = h_Filter[k];
+  }
+
+  for (b = 0; b < blocks; b++, dst += SIMD_BLOCK, src += SIMD_BLOCK) {
+    float sum[SIMD_BLOCK] = { 0 };
+
+    #pragma GCC unroll 17
+    for (k = -filterR; k <= filterR; k++) {
+      for (i = 0; i < SIMD_BLOCK; i++) {
+        sum[i] += src[i + k] * tap[filterR - k];
+      }
+    }
+
+    for (i = 0; i < SIMD_BLOCK; i++) {
+      dst[i] = sum[i];
+    }
+  }
+#endif
+}
+
+static inline __attribute__((always_inline))
+void columnBlocksFixed(float *dst, long dstStep, const float *src, long step,
+                       const float *h_Padded, const int filterR, int blocks) {
+
+  int b, j, r;
+  const float *tap = h_Padded + COLUMN_ROWS - 1 + 2 * filterR;
+
+  for (b = 0; b < blocks; b++, dst += SIMD_BLOCK, src += SIMD_BLOCK) {
+#if defined(__AVX__) && defined(__FMA__)
+    __m256 sum[COLUMN_ROWS][2];
+
+    #pragma GCC unroll 4
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      sum[r][0] = _mm256_setzero_ps();
+      sum[r][1] = _mm256_setzero_ps();
+    }
+
+    #pragma GCC unroll 20
+    for (j = -filterR; j < COLUMN_ROWS + filterR; j++) {
+      __m256 lo = _mm256_loadu_ps(src + j * step);
+      __m256 hi = _mm256_loadu_ps(src + j * step + 8);
+
+      #pragma GCC unroll 4
+      for (r = 0; r < COLUMN_ROWS; r++) {
+        __m256 f = _mm256_broadcast_ss(&tap[r - j - filterR]);
+
+        sum[r][0] = _mm256_fmadd_ps(lo, f, sum[r][0]);
+        sum[r][1] = _mm256_fmadd_ps(hi, f, sum[r][1]);
+      }
+    }
+
+    #pragma GCC unroll 4
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      _mm256_storeu_ps(dst + r * dstStep, sum[r][0]);
+      _mm256_storeu_ps(dst + r * dstStep + 8, sum[r][1]);
+    }
+#else
+    float sum[COLUMN_ROWS][SIMD_BLOCK] = { { 0 } };
+    int   i;
+
+    #pragma GCC unroll 20
+    for (j = -filterR; j < COLUMN_ROWS + filterR; j++) {
+      for (r = 0; r < COLUMN_ROWS; r++) {
+        for (i = 0; i < SIMD_BLOCK; i++) {
+          sum[r][i] += src[i + j * step] * tap[r - j - filterR];
+        }
+      }
+    }
+
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      for (i = 0; i < SIMD_BLOCK; i++) {
+        dst[i + r * dstStep] = sum[r][i];
+      }
+    }
+#endif
+  }
+}
+
+#define FIXED_RADIUS_KERNELS(R)                                                            \
+static void rowBlocks##R(float *dst, const float *src, const float *h_Filter,             \
+                         int filterR, int blocks) {                                        \
+  (void)filterR;                                                                           \
+  rowBlocksFixed(dst, src, h_Filter, R, blocks);                                           \
+}                                                                                          \
+static void columnBlocks##R(float *dst, long dstStep, const float *src, long step,        \
+                            const float *h_Padded, int filterR, int blocks) {              \
+  (void)filterR;                                                                           \
+  columnBlocksFixed(dst, dstStep, src, step, h_Padded, R, blocks);                         \
+}
+
+FIXED_RADIUS_KERNELS(1)
+FIXED_RADIUS_KERNELS(2)
+FIXED_RADIUS_KERNELS(3)
+FIXED_RADIUS_KERNELS(4)
+FIXED_RADIUS_KERNELS(5)
+FIXED_RADIUS_KERNELS(6)
+FIXED_RADIUS_KERNELS(7)
+FIXED_RADIUS_KERNELS(8)
+
+static const convolutionKernels genericKernels = { rowBlocksGeneric, columnBlocksGeneric };
+
+static const convolutionKernels fixedKernels[MAX_FIXED_RADIUS + 1] = {
+  { rowBlocksGeneric, columnBlocksGeneric },
+  { rowBlocks1, columnBlocks1 }, { rowBlocks2, columnBlocks2 },
+  { rowBlocks3, columnBlocks3 }, { rowBlocks4, columnBlocks4 },
+  { rowBlocks5, columnBlocks5 }, { rowBlocks6, columnBlocks6 },
+  { rowBlocks7, columnBlocks7 }, { rowBlocks8, columnBlocks8 }
+};
+
+static inline const convolutionKernels *selectKernels(int filterR) {
+  return (specializedKernels && filterR <= MAX_FIXED_RADIUS) ? &fixedKernels[filterR]
+                                                              : &genericKernels;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Row-filter pixels x0 to x1 of one image row: src points at the row's pixel
+// 0 and dst at where pixel x0 goes. The columns within filterR of the image
+// border, where some taps fall outside the image, are peeled off and get
+// clamped tap ranges.
+////////////////////////////////////////////////////////////////////////////////
+static void convolveRowSpan(float *dst, const float *src, const float *h_Filter,
+                            int filterR, int imageW, int x0, int x1) {
+
+  int x     = x0;
+  int left  = (filterR < x1) ? filterR : x1;
+  int right = (imageW - filterR > left) ? imageW - filterR : left;
+
+  if (right > x1) {
+    right = x1;
+  }
+
+  dst -= x0;
+
+  for (; x < left; x++) {
+    dst[x] = convolvePixel(src + x, h_Filter, filterR, -x,
+                           (imageW - 1 - x < filterR) ? imageW - 1 - x : filterR, 1);
+  }
+
+  if (x + SIMD_BLOCK <= right) {
+    int blocks = (right - x) / SIMD_BLOCK;
+
+    selectKernels(filterR)->rowBlocks(dst + x, src + x, h_Filter, filterR, blocks);
+    x += blocks * SIMD_BLOCK;
+  }
+
+  for (; x < right; x++) {
+    dst[x] = convolvePixel(src + x, h_Filter, filterR, -filterR, filterR, 1);
+  }
+
+  for (; x < x1; x++) {
+    dst[x] = convolvePixel(src + x, h_Filter, filterR, (x < filterR) ? -x : -filterR,
+                           imageW - 1 - x, 1);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Branch-free row convolution filter. The border columns get clamped tap
+// ranges; the columns in between read every tap and run SIMD_BLOCK pixels at
+// a time.
+////////////////////////////////////////////////////////////////////////////////
+void convolutionRowSIMD(float *h_Dst, float *h_Src, float *h_Filter,
+                        int imageW, int imageH, int filterR) {
+
+  int y;
+
+  for (y = 0; y < imageH; y++) {
+    convolveRowSpan(h_Dst + (long)y * imageW, h_Src + (long)y * imageW, h_Filter, filterR,
+                    imageW, 0, imageW);
+  }
+
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Branch-free column convolution filter. Every output row only needs its tap
+// range clamped to the rows inside the image; the row is then filtered
+// SIMD_BLOCK contiguous pixels at a time.
+////////////////////////////////////////////////////////////////////////////////
+void convolutionColumnSIMD(float *h_Dst, float *h_Src, float *h_Filter,
+                           int imageW, int imageH, int filterR) {
+
+  int x, y;
+
+  for (y = 0; y < imageH; y++) {
+    int    kLo = (y < filterR) ? -y : -filterR;
+    int    kHi = (imageH - 1 - y < filterR) ? imageH - 1 - y : filterR;
+    float *src = h_Src + (long)y * imageW;
+    float *dst = h_Dst + (long)y * imageW;
+
+    for (x = 0; x + SIMD_BLOCK <= imageW; x += SIMD_BLOCK) {
+      convolveBlock(dst + x, src + x, h_Filter, filterR, kLo, kHi, imageW);
+    }
+
+    for (; x < imageW; x++) {
+      dst[x] = convolvePixel(src + x, h_Filter, filterR, kLo, kHi, imageW);
+    }
+  }
+
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// The filter with COLUMN_ROWS - 1 zeros on each side, for convolveColumnRows()
+////////////////////////////////////////////////////////////////////////////////
+static float *padFilter(const float *h_Filter, int filterR) {
+
+  float *h_Padded = (float *)calloc(2 * filterR + 2 * COLUMN_ROWS - 1, sizeof(float));
+  int    k;
+
+  if (h_Padded != NULL) {
+    for (k = 0; k <= 2 * filterR; k++) {
+      h_Padded[COLUMN_ROWS - 1 + k] = h_Filter[k];
+    }
+  }
+
+  return h_Padded;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Output rows the next column step at row y covers: COLUMN_ROWS where all of
+// their taps are inside the image and the rows end by yEnd, else 1
+////////////////////////////////////////////////////////////////////////////////
+static inline int columnStepRows(int y, int yEnd, int imageH, int filterR) {
+  return (y >= filterR && y + COLUMN_ROWS - 1 + filterR < imageH && y + COLUMN_ROWS <= yEnd)
+         ? COLUMN_ROWS : 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// One column step: output rows y .. y + columnStepRows() - 1 (before yEnd),
+// pixels x0 to x1. dst points at output row y and src at its source row; the
+// output rows are dstStep floats apart and the source rows step. Returns the
+// number of rows done.
+////////////////////////////////////////////////////////////////////////////////
+static inline int convolveColumnStep(float *dst, long dstStep, const float *src, long step,
+                                     const float *h_Filter, const float *h_Padded, int filterR,
+                                     int y, int yEnd, int imageH, int x0, int x1) {
+
+  int x, r;
+  int rows = columnStepRows(y, yEnd, imageH, filterR);
+
+  if (rows == COLUMN_ROWS) {
+    int blocks = (x1 - x0) / SIMD_BLOCK;
+
+    selectKernels(filterR)->columnBlocks(dst + x0, dstStep, src + x0, step, h_Padded, filterR,
+                                         blocks);
+    x = x0 + blocks * SIMD_BLOCK;
+    for (r = 0; r < COLUMN_ROWS; r++) {
+      int xr;
+
+      for (xr = x; xr < x1; xr++) {
+        dst[xr + r * dstStep] = convolvePixel(src + xr + r * step, h_Filter, filterR,
+                                           -filterR, filterR, step);
+      }
+    }
+  } else {
+    int kLo = (y < filterR) ? -y : -filterR;
+    int kHi = (imageH - 1 - y < filterR) ? imageH - 1 - y : filterR;
+
+    for (x = x0; x + SIMD_BLOCK <= x1; x += SIMD_BLOCK) {
+      convolveBlock(dst + x, src + x, h_Filter, filterR, kLo, kHi, step);
+    }
+    for (; x < x1; x++) {
+      dst[x] = convolvePixel(src + x, h_Filter, filterR, kLo, kHi, step);
+    }
+  }
+
+  return rows;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Cache-blocked column convolution filter. Filtering whole rows reads 2R+1
+// full source rows per output row, which no longer fit in cache for wide
+// images and large radii, so every tap misses. The image is instead cut into
+// vertical strips whose 2R+1 row segments fit in STRIP_BYTES; a strip is
+// filtered top to bottom, and each source segment it loads is reused by the
+// 2R+1 output rows that need it before it is evicted. Inside a strip,
+// COLUMN_ROWS output rows are computed per load of a source row.
+////////////////////////////////////////////////////////////////////////////////
+void convolutionColumnBlocked(float *h_Dst, float *h_Src, float *h_Filter,
+                              int imageW, int imageH, int filterR) {
+
+  int    x0, y;
+  int    strip    = STRIP_BYTES / ((2 * filterR + 1) * (int)sizeof(float));
+  float *h_Padded = padFilter(h_Filter, filterR);
+
+  if (h_Padded == NULL) {
+    convolutionColumnSIMD(h_Dst, h_Src, h_Filter, imageW, imageH, filterR);
+    return;
+  }
+
+  strip = (strip < STRIP_MIN) ? STRIP_MIN : strip / SIMD_BLOCK * SIMD_BLOCK;
+
+  for (x0 = 0; x0 < imageW; x0 += strip) {
+    int x1 = (x0 + strip < imageW) ? x0 + strip : imageW;
+
+    for (y = 0; y < imageH; ) {
+      y += convolveColumnStep(h_Dst + (long)y * imageW, imageW, h_Src + (long)y * imageW,
+                              imageW, h_Filter, h_Padded, filterR, y, imageH, imageH, x0, x1);
+    }
+  }
+
+  free(h_Padded);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Fused separable convolution with a rolling line buffer. Instead of a full
+// W x H intermediate image, only the row-filtered lines the next column step
+// needs are kept, 2R + COLUMN_ROWS of them in a circular buffer: each step
+// row-filters the new source lines it needs and column-filters its output
+// rows straight from the buffer, while the lines are still in cache. Every
+// line is stored twice, lines slots apart, so that any lines consecutive
+// image lines are evenly spaced in the buffer and the column step runs on
+// them unchanged. Peak memory is the input, the output and O(R x W) floats.
+// Returns 0 if the line buffer cannot be allocated, 1 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int convolutionSeparableFused(float *h_Dst, float *h_Src, float *h_Filter,
+                              int imageW, int imageH, int filterR) {
+
+  int    y, next = 0;
+  int    lines    = 2 * filterR + COLUMN_ROWS;
+  float *h_Lines  = (float *)malloc(2 * (size_t)lines * imageW * sizeof(float));
+  float *h_Padded = padFilter(h_Filter, filterR);
+
+  if (h_Lines == NULL || h_Padded == NULL) {
+    free(h_Lines);
+    free(h_Padded);
+    return 0;
+  }
+
+  for (y = 0; y < imageH; ) {
+    int last = y + columnStepRows(y, imageH, imageH, filterR) - 1 + filterR;
+    int kLo  = (y < filterR) ? -y : -filterR;
+
+    // row-filter the lines up to the last one this step reads; line d goes
+    // to slots d % lines and d % lines + lines
+    for (; next <= last && next < imageH; next++) {
+      float *line = h_Lines + (long)(next % lines) * imageW;
+
+      convolutionRowSIMD(line, h_Src + (long)next * imageW, h_Filter, imageW, 1, filterR);
+      memcpy(line + (long)lines * imageW, line, imageW * sizeof(float));
+    }
+
+    // lines y + kLo, y + kLo + 1, ... follow each other from slot
+    // (y + kLo) % lines on, so line y is -kLo lines further
+    y += convolveColumnStep(h_Dst + (long)y * imageW, imageW,
+                            h_Lines + (long)((y + kLo) % lines - kLo) * imageW, imageW,
+                            h_Filter, h_Padded, filterR, y, imageH, imageH, 0, imageW);
+  }
+
+  free(h_Padded);
+  free(h_Lines);
+  return 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Multi-threaded separable convolution over 2D tiles. Each tile is filtered
+// on its own by one thread: the row pass fills a per-thread buffer with the
+// tile's columns of its rows and of the filterR halo rows above and below
+// (the row taps read the input directly, so no column halo is stored), then
+// the column pass writes the tile's output from that buffer while it is in
+// cache. Tiles share no intermediate data and are handed out dynamically.
+// Returns 0 if a thread's tile buffer cannot be allocated, 1 otherwise.
+////////////////////////////////////////////////////////////////////////////////
+int convolutionSeparableTiled(float *h_Dst, float *h_Src, float *h_Filter,
+                              int imageW, int imageH, int filterR) {
+
+  // the halo rows are row-filtered by both tiles they border: tiles at least
+  // 4R high keep that overhead at or below half the row pass
+  int    tileH    = (4 * filterR > TILE_H) ? 4 * filterR : TILE_H;
+  int    tilesX   = (imageW + TILE_W - 1) / TILE_W;
+  int    tilesY   = (imageH + tileH - 1) / tileH;
+  int    failed   = 0;
+  float *h_Padded = padFilter(h_Filter, filterR);
+
+  if (h_Padded == NULL) {
+    return 0;
+  }
+
+  #pragma omp parallel
+  {
+    float *h_Tile = (float *)malloc((size_t)(tileH + 2 * filterR) * TILE_W * sizeof(float));
+    int    tile;
+
+    if (h_Tile == NULL) {
+      #pragma omp atomic write
+      failed = 1;
+    }
+
+    #pragma omp for schedule(dynamic)
+    for (tile = 0; tile < tilesX * tilesY; tile++) {
+      int x0     = tile % tilesX * TILE_W;
+      int y0     = tile / tilesX * tileH;
+      int x1     = (x0 + TILE_W < imageW) ? x0 + TILE_W : imageW;
+      int y1     = (y0 + tileH < imageH) ? y0 + tileH : imageH;
+      int top    = (y0 - filterR > 0) ? y0 - filterR : 0;
+      int bottom = (y1 + filterR < imageH) ? y1 + filterR : imageH;
+      int y;
+
+      if (h_Tile == NULL) {
+        continue;
+      }
+
+      // buffer row i holds image row top + i, pixels x0 to x1
+      for (y = top; y < bottom; y++) {
+        convolveRowSpan(h_Tile + (long)(y - top) * TILE_W, h_Src + (long)y * imageW, h_Filter,
+                        filterR, imageW, x0, x1);
+      }
+
+      for (y = y0; y < y1; ) {
+        y += convolveColumnStep(h_Dst + (long)y * imageW + x0, imageW,
+                                h_Tile + (long)(y - top) * TILE_W, TILE_W, h_Filter, h_Padded,
+                                filterR, y, y1, imageH, 0, x1 - x0);
+      }
+    }
+
+    free(h_Tile);
+  }
+
+  free(h_Padded);
+  return !failed;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OpenMP thread count, 1 when built without OpenMP
+////////////////////////////////////////////////////////////////////////////////
+static int maxThreads(void) {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static void setThreads(int threads) {
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#else
+  (void)threads;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Radix-2 complex FFTs of n points (a power of two) on split real and
+// imaginary arrays, unnormalized. The twiddles of the stage that combines
+// halves of length h are exp(-i pi j / h), j < h, stored at index h + j.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+  int    n;
+  int   *bitRev;
+  float *cosTable;
+  float *sinTable;
+} fftPlan;
+
+static void fftPlanFree(fftPlan *plan) {
+  free(plan->bitRev);
+  free(plan->cosTable);
+  free(plan->sinTable);
+}
+
+// returns 0 if the tables cannot be allocated
+static int fftPlanInit(fftPlan *plan, int n) {
+
+  static const double PI = 3.14159265358979323846;  // M_PI is not in strict C99
+  int                 i, h, bits = 0;
+
+  plan->n        = n;
+  plan->bitRev   = (int *)malloc(n * sizeof(int));
+  plan->cosTable = (float *)malloc(n * sizeof(float));
+  plan->sinTable = (float *)malloc(n * sizeof(float));
+  if (plan->bitRev == NULL || plan->cosTable == NULL || plan->sinTable == NULL) {
+    fftPlanFree(plan);
+    return 0;
+  }
+
+  while ((1 << bits) < n) {
+    bits++;
+  }
+  for (i = 0; i < n; i++) {
+    int b, rev = 0;
+
+    for (b = 0; b < bits; b++) {
+      rev |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    plan->bitRev[i] = rev;
+  }
+
+  for (h = 1; h < n; h *= 2) {
+    for (i = 0; i < h; i++) {
+      plan->cosTable[h + i] = (float)cos(PI * i / h);
+      plan->sinTable[h + i] = (float)-sin(PI * i / h);
+    }
+  }
+
+  return 1;
+}
+
+// For every column c in [c0, c1), transforms the n values re/im[i * stride + c].
+// The butterflies combine whole row segments with one twiddle, so the inner
+// loop runs over contiguous columns; stride 1 and one column is a plain 1D FFT.
+static void fft(float *re, float *im, const fftPlan *plan, long stride, int c0, int c1,
+                int inverse) {
+
+  int   i, j, h, c, n = plan->n;
+  float sign = inverse ? -1.0f : 1.0f;
+
+  for (i = 0; i < n; i++) {
+    j = plan->bitRev[i];
+    if (j > i) {
+      float *restrict ar = re + i * stride, *restrict ai = im + i * stride;
+      float *restrict br = re + j * stride, *restrict bi = im + j * stride;
+
+      for (c = c0; c < c1; c++) {
+        float t;
+
+        t = ar[c]; ar[c] = br[c]; br[c] = t;
+        t = ai[c]; ai[c] = bi[c]; bi[c] = t;
+      }
+    }
+  }
+
+  for (h = 1; h < n; h *= 2) {
+    for (i = 0; i < n; i += 2 * h) {
+      for (j = 0; j < h; j++) {
+        float wr = plan->cosTable[h + j];
+        float wi = sign * plan->sinTable[h + j];
+        float *restrict ar = re + (i + j) * stride, *restrict ai = im + (i + j) * stride;
+        float *restrict br = re + (i + j + h) * stride, *restrict bi = im + (i + j + h) * stride;
+
+        c = c0;
+#if defined(__AVX__) && defined(__FMA__)
+        {
+          __m256 vwr = _mm256_set1_ps(wr), vwi = _mm256_set1_ps(wi);
+
+          for (; c + 8 <= c1; c += 8) {
+            __m256 xr = _mm256_loadu_ps(br + c), xi = _mm256_loadu_ps(bi + c);
+            __m256 yr = _mm256_loadu_ps(ar + c), yi = _mm256_loadu_ps(ai + c);
+            __m256 tr = _mm256_fmsub_ps(xr, vwr, _mm256_mul_ps(xi, vwi));
+            __m256 ti = _mm256_fmadd_ps(xr, vwi, _mm256_mul_ps(xi, vwr));
+
+            _mm256_storeu_ps(br + c, _mm256_sub_ps(yr, tr));
+            _mm256_storeu_ps(bi + c, _mm256_sub_ps(yi, ti));
+            _mm256_storeu_ps(ar + c, _mm256_add_ps(yr, tr));
+            _mm256_storeu_ps(ai + c, _mm256_add_ps(yi, ti));
+          }
+        }
+#endif
+        for (; c < c1; c++) {
+          float tr = br[c] * wr - bi[c] * wi;
+          float ti = br[c] * wi + bi[c] * wr;
+
+          br[c] = ar[c] - tr;
+          bi[c] = ai[c] - ti;
+          ar[c] += tr;
+          ai[c] += ti;
+        }
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// In-place transpose of a square n x n plane, in 16 x 16 blocks: with n a
+// power of two, the rows of larger blocks fall into the same L1 sets
+////////////////////////////////////////////////////////////////////////////////
+static void transposeSquare(float *a, int n) {
+
+  int ib, jb, i, j;
+
+  for (ib = 0; ib < n; ib += 16) {
+    for (jb = ib; jb < n; jb += 16) {
+      for (i = ib; i < ib + 16 && i < n; i++) {
+        for (j = (jb == ib) ? i + 1 : jb; j < jb + 16 && j < n; j++) {
+          float t = a[(long)i * n + j];
+
+          a[(long)i * n + j] = a[(long)j * n + i];
+          a[(long)j * n + i] = t;
+        }
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FFT edge for the overlap-add engine: each tile takes a block of
+// (T - 2R) x (T - 2R) pixels, whose output spreads R further on every side.
+// Of the powers of two from 4R up to FFT_MAX, picks the one with the fewest
+// estimated flops for the image (tiles x T^2 log T); 0 if none is large
+// enough.
+////////////////////////////////////////////////////////////////////////////////
+static int fftTileSize(int imageW, int imageH, int filterR) {
+
+  int    t, best = 0, logT;
+  double bestCost = 0;
+
+  for (t = 64, logT = 6; t <= FFT_MAX; t *= 2, logT++) {
+    int    block = t - 2 * filterR;
+    double cost;
+
+    // same-parity blocks must be at least 2R apart, see convolutionSeparableFFT()
+    if (block < 2 * filterR) {
+      continue;
+    }
+
+    cost = (double)((imageW + block - 1) / block) * ((imageH + block - 1) / block) *
+           t * (double)t * logT;
+    if (best == 0 || cost < bestCost) {
+      best     = t;
+      bestCost = cost;
+    }
+  }
+
+  return best;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FFT convolution with overlap-add tiling, for large radii where the direct
+// passes cost O(R) per pixel. The image is cut into blocks of T - 2R pixels
+// square; each is zero-padded to a T x T tile, transformed, multiplied by
+// the filter's spectrum and transformed back, and its T x T result (the
+// block plus R on every side) is added into h_Dst. Two real tiles go through
+// one complex transform, one as the real and one as the imaginary part: the
+// filter is real, so the two results come back separated in the real and
+// imaginary parts, for half the work of one transform per tile. The filter
+// is separable, so its 2D spectrum is F(u) F(v) of its 1D spectrum F. Blocks
+// of the same row and column parity are at least 2R apart and their results
+// do not overlap, so the four parity classes are run one after another, each
+// in parallel. Returns 0 if the tiles or plan cannot be allocated, or if
+// the radius is too large for FFT_MAX.
+////////////////////////////////////////////////////////////////////////////////
+int convolutionSeparableFFT(float *h_Dst, float *h_Src, float *h_Filter,
+                            int imageW, int imageH, int filterR) {
+
+  int     tile = fftTileSize(imageW, imageH, filterR);
+  int     block, blocksX, blocksY, failed = 0, k;
+  fftPlan plan;
+  float  *h_SpectrumRe, *h_SpectrumIm;
+
+  if (tile == 0 || !fftPlanInit(&plan, tile)) {
+    return 0;
+  }
+
+  block        = tile - 2 * filterR;
+  blocksX      = (imageW + block - 1) / block;
+  blocksY      = (imageH + block - 1) / block;
+  h_SpectrumRe = (float *)calloc(tile, sizeof(float));
+  h_SpectrumIm = (float *)calloc(tile, sizeof(float));
+  if (h_SpectrumRe == NULL || h_SpectrumIm == NULL) {
+    free(h_SpectrumRe);
+    free(h_SpectrumIm);
+    fftPlanFree(&plan);
+    return 0;
+  }
+
+  // out[x] = sum over k of in[x + k] h_Filter[filterR - k] is the circular
+  // convolution with h[d] = h_Filter[filterR + d], stored at d mod tile; the
+  // 1 / tile^2 of the inverse transform is folded into F
+  for (k = -filterR; k <= filterR; k++) {
+    h_SpectrumRe[(k + tile) % tile] = h_Filter[filterR + k] / tile;
+  }
+  fft(h_SpectrumRe, h_SpectrumIm, &plan, 1, 0, 1, 0);
+
+  #pragma omp parallel
+  {
+    float *re = (float *)malloc((size_t)tile * tile * sizeof(float));
+    float *im = (float *)malloc((size_t)tile * tile * sizeof(float));
+    int    phase, pair, y;
+
+    if (re == NULL || im == NULL) {
+      #pragma omp atomic write
+      failed = 1;
+    }
+
+    #pragma omp for schedule(static)
+    for (y = 0; y < imageH; y++) {
+      memset(h_Dst + (long)y * imageW, 0, imageW * sizeof(float));
+    }
+
+    for (phase = 0; phase < 4; phase++) {
+      int px = phase % 2, py = phase / 2;
+      int nx = (blocksX - px + 1) / 2, ny = (blocksY - py + 1) / 2;
+
+      #pragma omp for schedule(dynamic)
+      for (pair = 0; pair < (nx * ny + 1) / 2; pair++) {
+        int x0[2], y0[2], w[2], h[2], b, count = 0, cols = 0, i, u, v;
+
+        if (re == NULL || im == NULL) {
+          continue;
+        }
+
+        for (b = 2 * pair; b < 2 * pair + 2 && b < nx * ny; b++, count++) {
+          x0[count] = (px + 2 * (b % nx)) * block;
+          y0[count] = (py + 2 * (b / nx)) * block;
+          w[count]  = (x0[count] + block < imageW) ? block : imageW - x0[count];
+          h[count]  = (y0[count] + block < imageH) ? block : imageH - y0[count];
+          if (w[count] > cols) {
+            cols = w[count];
+          }
+        }
+
+        // block pixel (i, j) goes to tile pixel (R + i, R + j)
+        memset(re, 0, (size_t)tile * tile * sizeof(float));
+        memset(im, 0, (size_t)tile * tile * sizeof(float));
+        for (b = 0; b < count; b++) {
+          float *plane = b ? im : re;
+
+          for (i = 0; i < h[b]; i++) {
+            memcpy(plane + (long)(filterR + i) * tile + filterR,
+                   h_Src + (long)(y0[b] + i) * imageW + x0[b], w[b] * sizeof(float));
+          }
+        }
+
+        // forward 2D transform, down the columns and then, transposed, down
+        // the rows: the columns outside R .. R + cols are zero and stay zero.
+        // The spectrum is left transposed, [u][v]
+        fft(re, im, &plan, tile, filterR, filterR + cols, 0);
+        transposeSquare(re, tile);
+        transposeSquare(im, tile);
+        fft(re, im, &plan, tile, 0, tile, 0);
+
+        for (u = 0; u < tile; u++) {
+          for (v = 0; v < tile; v++) {
+            long  at = (long)u * tile + v;
+            float kr = h_SpectrumRe[u] * h_SpectrumRe[v] - h_SpectrumIm[u] * h_SpectrumIm[v];
+            float ki = h_SpectrumRe[u] * h_SpectrumIm[v] + h_SpectrumIm[u] * h_SpectrumRe[v];
+            float xr = re[at], xi = im[at];
+
+            re[at] = xr * kr - xi * ki;
+            im[at] = xr * ki + xi * kr;
+          }
+        }
+
+        fft(re, im, &plan, tile, 0, tile, 1);
+        transposeSquare(re, tile);
+        transposeSquare(im, tile);
+        fft(re, im, &plan, tile, 0, tile, 1);
+
+        // tile pixel (i, j) is image pixel (y0 - R + i, x0 - R + j)
+        for (b = 0; b < count; b++) {
+          float *plane = b ? im : re;
+          int    xLo   = (x0[b] - filterR < 0) ? filterR - x0[b] : 0;
+          int    xHi   = (x0[b] + w[b] + filterR > imageW) ? imageW - x0[b] + filterR
+                                                           : w[b] + 2 * filterR;
+
+          for (i = 0; i < h[b] + 2 * filterR; i++) {
+            int    yy = y0[b] - filterR + i, j;
+            float *dst;
+
+            if (yy < 0 || yy >= imageH) {
+              continue;
+            }
+            dst = h_Dst + (long)yy * imageW;
+            for (j = xLo; j < xHi; j++) {
+              dst[x0[b] - filterR + j] += plane[(long)i * tile + j];
+            }
+          }
+        }
+      }
+    }
+
+    free(re);
+    free(im);
+  }
+
+  free(h_SpectrumRe);
+  free(h_SpectrumIm);
+  fftPlanFree(&plan);
+  return !failed;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Smallest radius from which the FFT engine beats the direct tiled engine on
+// this host, measured on the first call on a CROSSOVER_SIZE^2 image with the
+// current number of threads: the radius is doubled from 4 until the FFT
+// wins, then bisected between the last two radii. CONV_FFT_CROSSOVER in the
+// environment overrides the measurement. A radius the FFT never wins at
+// gives INT_MAX-like 1 << 30.
+////////////////////////////////////////////////////////////////////////////////
+#define CROSSOVER_SIZE 1024
+
+static double timeEngine(int fft, float *h_Dst, float *h_Src, float *h_Filter,
+                         int imageW, int filterR) {
+
+  double seconds = now();
+  int    ok;
+
+  if (fft) {
+    ok = convolutionSeparableFFT(h_Dst, h_Src, h_Filter, imageW, imageW, filterR);
+  } else {
+    ok = convolutionSeparableTiled(h_Dst, h_Src, h_Filter, imageW, imageW, filterR);
+  }
+
+  return ok ? now() - seconds : 1e30;
+}
+
+int convolutionCrossover(void) {
+
+  static int crossover = 0;
+  long       n = (long)CROSSOVER_SIZE * CROSSOVER_SIZE, i;
+  float     *h_Src, *h_Dst, h_Filter[2 * (FFT_MAX / 4) + 1];
+  unsigned   seed = 1;
+  int        lo, hi;
+
+  if (crossover > 0) {
+    return crossover;
+  }
+  if (getenv("CONV_FFT_CROSSOVER") != NULL && atoi(getenv("CONV_FFT_CROSSOVER")) > 0) {
+    return crossover = atoi(getenv("CONV_FFT_CROSSOVER"));
+  }
+
+  h_Src = (float *)malloc(n * sizeof(float));
+  h_Dst = (float *)malloc(n * sizeof(float));
+  if (h_Src == NULL || h_Dst == NULL) {
+    free(h_Src);
+    free(h_Dst);
+    return 1 << 30;
+  }
+
+  // a private generator, so the caller's rand() sequence is left alone
+  for (i = 0; i < n; i++) {
+    seed     = seed * 1103515245u + 12345u;
+    h_Src[i] = (float)((seed >> 16) & 255);
+  }
+  for (i = 0; i < 2 * (FFT_MAX / 4) + 1; i++) {
+    h_Filter[i] = 1.0f;
+  }
+
+  crossover = 1 << 30;
+  for (hi = 4; 4 * hi <= FFT_MAX; hi *= 2) {
+    if (timeEngine(1, h_Dst, h_Src, h_Filter, CROSSOVER_SIZE, hi) <
+        timeEngine(0, h_Dst, h_Src, h_Filter, CROSSOVER_SIZE, hi)) {
+      break;
+    }
+  }
+
+  if (4 * hi <= FFT_MAX) {
+    lo = hi / 2;
+    while (hi - lo > 1 && hi > 4) {
+      int mid = (lo + hi) / 2;
+
+      if (timeEngine(1, h_Dst, h_Src, h_Filter, CROSSOVER_SIZE, mid) <
+          timeEngine(0, h_Dst, h_Src, h_Filter, CROSSOVER_SIZE, mid)) {
+        hi = mid;
+      } else {
+        lo = mid;
+      }
+    }
+    crossover = hi;
+  }
+
+  free(h_Src);
+  free(h_Dst);
+  return crossover;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Separable convolution with the engine that is faster for the radius: the
+// FFT engine from the measured crossover radius on, else the direct tiled
+// engine. Returns 0 on allocation failure.
+////////////////////////////////////////////////////////////////////////////////
+int convolutionSeparableAuto(float *h_Dst, float *h_Src, float *h_Filter,
+                             int imageW, int imageH, int filterR) {
+
+  if (filterR >= convolutionCrossover() &&
+      convolutionSeparableFFT(h_Dst, h_Src, h_Filter, imageW, imageH, filterR)) {
+    return 1;
+  }
+
+  return convolutionSeparableTiled(h_Dst, h_Src, h_Filter, imageW, imageH, filterR);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Largest error of h_Output against the reference, relative to the reference
+// value (absolute where that is below 1)
+////////////////////////////////////////////////////////////////////////////////
+static double maxRelativeError(float *h_Reference, float *h_Output, long n) {
+
+  double maxError = 0;
+  long   i;
+
+  for (i = 0; i < n; i++) {
+    double diff  = ABS((double)h_Reference[i] - h_Output[i]);
+    double scale = ABS((double)h_Reference[i]);
+
+    if (scale > 1.0) {
+      diff /= scale;
+    }
+    if (diff > maxError) {
+      maxError = diff;
+    }
+  }
+
+  return maxError;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Print one engine's time against the reference and check its output;
+// returns 1 if the output is within accuracy
+////////////////////////////////////////////////////////////////////////////////
+static int report(const char *name, double seconds, double timeCPU,
+                  float *h_Reference, float *h_Output, long n) {
+
+  double error = maxRelativeError(h_Reference, h_Output, n);
+
+  printf("%-24s: %10.4f sec (%6.2fx), max relative error %g%s\n", name, seconds,
+         timeCPU / seconds, error, (error > accuracy) ? "  FAILED" : "");
+
+  return error <= accuracy;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Radius benchmark (run with -k): for every radius up to MAX_FIXED_RADIUS + 1,
+// the row pass and the blocked column pass on an imageW x imageW image, with
+// the generic kernels and with the ones selectKernels() dispatches to, in
+// Mpixels/s (best of 3 runs). The last radius shows the generic fallback.
+////////////////////////////////////////////////////////////////////////////////
+static int benchmarkRadii(int imageW) {
+
+  long   n         = (long)imageW * imageW;
+  float *h_Input   = (float *)malloc(n * sizeof(float));
+  float *h_Buffer  = (float *)malloc(n * sizeof(float));
+  float *h_Generic = (float *)malloc(n * sizeof(float));
+  float *h_Fixed   = (float *)malloc(n * sizeof(float));
+  float  h_Filter[2 * (MAX_FIXED_RADIUS + 1) + 1];
+  int    passed = 1, radius, k, run, specialized;
+  long   i;
+
+  if (h_Input == NULL || h_Buffer == NULL || h_Generic == NULL || h_Fixed == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  srand(200);
+  for (i = 0; i < n; i++) {
+    h_Input[i] = (float)rand() / ((float)RAND_MAX / 255) + (float)rand() / (float)RAND_MAX;
+  }
+
+  printf("\nMpixels/s on %d x %d, generic vs specialized kernels:\n", imageW, imageW);
+  printf("  %6s %10s %10s %7s %10s %10s %7s\n", "radius", "row gen", "row spec", "speedup",
+         "col gen", "col spec", "speedup");
+
+  for (radius = 1; radius <= MAX_FIXED_RADIUS + 1; radius++) {
+    double rowTime[2], columnTime[2], error;
+
+    for (k = 0; k <= 2 * radius; k++) {
+      h_Filter[k] = (float)(rand() % 16);
+    }
+
+    for (specialized = 0; specialized <= 1; specialized++) {
+      float *h_Output = specialized ? h_Fixed : h_Generic;
+
+      specializedKernels    = specialized;
+      rowTime[specialized]    = 1e30;
+      columnTime[specialized] = 1e30;
+
+      for (run = 0; run < 3; run++) {
+        double seconds = now();
+
+        convolutionRowSIMD(h_Buffer, h_Input, h_Filter, imageW, imageW, radius);
+        seconds = now() - seconds;
+        if (seconds < rowTime[specialized]) {
+          rowTime[specialized] = seconds;
+        }
+
+        seconds = now();
+        convolutionColumnBlocked(h_Output, h_Buffer, h_Filter, imageW, imageW, radius);
+        seconds = now() - seconds;
+        if (seconds < columnTime[specialized]) {
+          columnTime[specialized] = seconds;
+        }
+      }
+    }
+    specializedKernels = 1;
+
+    error   = maxRelativeError(h_Generic, h_Fixed, n);
+    passed &= error <= accuracy;
+
+    printf("  %6d %10.1f %10.1f %6.2fx %10.1f %10.1f %6.2fx%s\n", radius,
+           n / rowTime[0] / 1e6, n / rowTime[1] / 1e6, rowTime[0] / rowTime[1],
+           n / columnTime[0] / 1e6, n / columnTime[1] / 1e6, columnTime[0] / columnTime[1],
+           (error > accuracy) ? "  FAILED" : "");
+  }
+
+  free(h_Fixed);
+  free(h_Generic);
+  free(h_Buffer);
+  free(h_Input);
+
+  return passed ? 0 : 1;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Main program
 ////////////////////////////////////////////////////////////////////////////////
@@ -77,13 +1328,27 @@ int main(int argc, char **argv) {
     *h_Filter,
     *h_Input,
     *h_Buffer,
-    *h_OutputCPU;
+    *h_OutputCPU,
+    *h_OutputSIMD;
+
+    double timeCPU, timeRow, timeColumn, timeBlocked, timeFused, timeTiled, timeOne, timeFFT;
+    double timeAuto;
+    long   n;
+    int    passed = 1, threads, t, crossover;
+    char   name[32];
 
 
     int imageW;
     int imageH;
     unsigned int i;
 
+    // -k: benchmark the kernels specialized per radius instead
+    if (argc > 1 && strcmp(argv[1], "-k") == 0) {
+        printf("Enter image size : ");
+        scanf("%d", &imageW);
+        return benchmarkRadii(imageW);
+    }
+
 	printf("Enter filter radius : ");
 	scanf("%d", &filter_radius);
 
@@ -102,6 +1367,12 @@ int main(int argc, char **argv) {
     h_Input     = (float *)malloc(imageW * imageH * sizeof(float));
     h_Buffer    = (float *)malloc(imageW * imageH * sizeof(float));
     h_OutputCPU = (float *)malloc(imageW * imageH * sizeof(float));
+    h_OutputSIMD = (float *)malloc(imageW * imageH * sizeof(float));
+    if (h_Filter == NULL || h_Input == NULL || h_Buffer == NULL || h_OutputCPU == NULL ||
+        h_OutputSIMD == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
 
     // to 'h_Filter' apotelei to filtro me to opoio ginetai to convolution kai
     // arxikopoieitai tuxaia. To 'h_Input' einai h eikona panw sthn opoia ginetai
@@ -121,16 +1392,132 @@ int main(int argc, char **argv) {
     // To parakatw einai to kommati pou ekteleitai sthn CPU kai me vash auto prepei na ginei h sugrish me thn GPU.
     printf("CPU computation...\n");
 
+    timeCPU = now();
     convolutionRowCPU(h_Buffer, h_Input, h_Filter, imageW, imageH, filter_radius); // convolution kata grammes
     convolutionColumnCPU(h_OutputCPU, h_Buffer, h_Filter, imageW, imageH, filter_radius); // convolution kata sthles
+    timeCPU = now() - timeCPU;
+
+    n = (long)imageW * imageH;
+
+    printf("SIMD computation...\n\n");
+
+    printf("%-24s: %10.4f sec\n", "Reference", timeCPU);
+
+    timeRow = now();
+    convolutionRowSIMD(h_Buffer, h_Input, h_Filter, imageW, imageH, filter_radius);
+    timeRow = now() - timeRow;
+
+    timeColumn = now();
+    convolutionColumnSIMD(h_OutputSIMD, h_Buffer, h_Filter, imageW, imageH, filter_radius);
+    timeColumn = now() - timeColumn;
 
 
     // Kanete h sugrish anamesa se GPU kai CPU kai an estw kai kapoio apotelesma xeperna thn akriveia
     // pou exoume orisei, tote exoume sfalma kai mporoume endexomenws na termatisoume to programma mas  
+    passed &= report("SIMD", timeRow + timeColumn, timeCPU, h_OutputCPU, h_OutputSIMD, n);
+
+    // the blocked column pass filters the same row pass output
+    timeBlocked = now();
+    convolutionColumnBlocked(h_OutputSIMD, h_Buffer, h_Filter, imageW, imageH, filter_radius);
+    timeBlocked = now() - timeBlocked;
+
+    passed &= report("SIMD, blocked columns", timeRow + timeBlocked, timeCPU, h_OutputCPU,
+                     h_OutputSIMD, n);
+
+    timeFused = now();
+    if (!convolutionSeparableFused(h_OutputSIMD, h_Input, h_Filter, imageW, imageH,
+                                   filter_radius)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    timeFused = now() - timeFused;
+
+    passed &= report("Fused, line buffer", timeFused, timeCPU, h_OutputCPU, h_OutputSIMD, n);
+
+    threads = maxThreads();
+
+    timeTiled = now();
+    if (!convolutionSeparableTiled(h_OutputSIMD, h_Input, h_Filter, imageW, imageH,
+                                   filter_radius)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    timeTiled = now() - timeTiled;
+
+    snprintf(name, sizeof(name), "Tiled, %d thread%s", threads, (threads > 1) ? "s" : "");
+    passed &= report(name, timeTiled, timeCPU, h_OutputCPU, h_OutputSIMD, n);
+
+    timeFFT = now();
+    if (convolutionSeparableFFT(h_OutputSIMD, h_Input, h_Filter, imageW, imageH,
+                                filter_radius)) {
+        timeFFT = now() - timeFFT;
+        passed &= report("FFT, overlap-add", timeFFT, timeCPU, h_OutputCPU, h_OutputSIMD, n);
+    } else {
+        printf("%-24s: radius too large for %d-point tiles\n", "FFT, overlap-add", FFT_MAX);
+    }
+
+    printf("\n  row pass %.4f sec, column pass %.4f sec, blocked column pass %.4f sec\n",
+           timeRow, timeColumn, timeBlocked);
+    printf("  memory: two passes %.1f MB, fused %.1f MB\n",
+           3.0 * n * sizeof(float) / 1e6,
+           (2.0 * n + 2.0 * (2 * filter_radius + COLUMN_ROWS) * imageW) * sizeof(float) / 1e6);
+
+    // scaling of the tiled engine: 1, 2, 4, ... threads and the maximum
+    printf("\nTiled scaling:\n");
+    printf("  %7s %10s %8s %10s\n", "threads", "seconds", "speedup", "efficiency");
+    timeOne = 0;
+    for (t = 1; ; t = (2 * t < threads) ? 2 * t : threads) {
+        double seconds;
+
+        setThreads(t);
+        seconds = now();
+        convolutionSeparableTiled(h_OutputSIMD, h_Input, h_Filter, imageW, imageH, filter_radius);
+        seconds = now() - seconds;
+        if (t == 1) {
+            timeOne = seconds;
+        }
+
+        printf("  %7d %10.4f %8.2f %9.1f%%\n", t, seconds, timeOne / seconds,
+               100.0 * timeOne / seconds / t);
+        if (t == threads) {
+            break;
+        }
+    }
+    setThreads(threads);
+
+    // the engine convolutionSeparableAuto() picks for this radius, checked
+    // like the others
+    timeOne   = now();
+    crossover = convolutionCrossover();
+    timeOne   = now() - timeOne;
+    if (crossover < (1 << 30)) {
+        printf("\nFFT crossover radius: %d (measured in %.2f sec)\n", crossover, timeOne);
+    } else {
+        printf("\nFFT crossover radius: none up to %d (measured in %.2f sec)\n", FFT_MAX / 4,
+               timeOne);
+    }
+
+    timeAuto = now();
+    if (!convolutionSeparableAuto(h_OutputSIMD, h_Input, h_Filter, imageW, imageH,
+                                  filter_radius)) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    timeAuto = now() - timeAuto;
+
+    snprintf(name, sizeof(name), "Auto, %s",
+             ((int)filter_radius >= crossover && fftTileSize(imageW, imageH, filter_radius) > 0)
+             ? "FFT" : "tiled");
+    passed &= report(name, timeAuto, timeCPU, h_OutputCPU, h_OutputSIMD, n);
+
+    if (!passed) {
+        printf("TEST FAILED: error above the accuracy of %g\n", accuracy);
+    }
 
 
 
     // free all the allocated memory
+    free(h_OutputSIMD);
     free(h_OutputCPU);
     free(h_Buffer);
     free(h_Input);
@@ -140,5 +1527,5 @@ int main(int argc, char **argv) {
     // cudaDeviceReset();
 
 
-    return 0;
+    return passed ? 0 : 1;
 }